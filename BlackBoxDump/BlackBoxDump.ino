@@ -0,0 +1,40 @@
+#include "eepromlayout.h"
+
+// Print the black box recording stored in EEPROM as hexadecimal text, for
+// decoding on the host with tools/bbdecode.
+
+typedef EEPromLayout::BlackBoxRecording Item;
+
+void setup()
+{
+    Serial.begin(9600);
+
+    uint16_t used;
+    if (EEPromLayout::read<Item>(&used, sizeof(used)) < 0
+        || used > Item::len - sizeof(used))
+    {
+        Serial.println("No black box recording found");
+        return;
+    }
+
+    Serial.print("BLACKBOX ");
+    Serial.println(used);
+    for (uint16_t pos = 0; pos < used; pos += 32)
+    {
+        uint8_t line[32];
+        uint8_t n = min(uint16_t(used - pos), uint16_t(sizeof(line)));
+        EEPromLayout::read<Item>(line, n, sizeof(used) + pos);
+        for (uint8_t i = 0; i < n; ++i)
+        {
+            if (line[i] < 0x10)
+                Serial.print('0');
+            Serial.print(line[i], HEX);
+        }
+        Serial.println();
+    }
+    Serial.println("END");
+}
+
+void loop()
+{
+}
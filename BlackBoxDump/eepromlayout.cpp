@@ -0,0 +1 @@
+../eepromlayout.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../eepromlayout.h
\ No newline at end of file
@@ -10,7 +10,7 @@ void setup()
     Serial.begin(9600);
     sensor.begin();
 
-    if (EEPromLayout::read("BNOC", calib_data, sizeof(calib_data)) == sizeof(calib_data))
+    if (EEPromLayout::read<EEPromLayout::BNO055Calibration>(calib_data, sizeof(calib_data)) == sizeof(calib_data))
     {
         Serial.println("Setting calibration constants from old EEPROM data");
         sensor.setSensorOffsets(calib_data);
@@ -60,7 +60,7 @@ void loop()
 
         if (!stored)
         {
-            if (EEPromLayout::write("BNOC", calib_data, sizeof(calib_data)))
+            if (EEPromLayout::write<EEPromLayout::BNO055Calibration>(calib_data, sizeof(calib_data)))
             {
                 Serial.println("Values stored in EEPROM");
                 stored = true;
@@ -0,0 +1 @@
+../hal.h
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "bno055.h"
+#include "eepromlayout.h"
+#include "engine.h"
+
+// Yaw rate (rad/s) above which a motor is considered to be turning the robot
+const double moving_rate = 0.05;
+// Yaw rate (rad/s) below which the robot is considered to drive straight
+const double straight_rate = 0.005;
+// Time to let the robot settle after a speed change, in ms
+const uint16_t settle_ms = 300;
+// Time over which to average the yaw rate, in ms
+const uint16_t measure_ms = 700;
+// Step size in PWM value when searching for the deadband
+const uint16_t deadband_step = 32;
+// Number of bisection steps when searching for a gain
+const uint8_t gain_iterations = 6;
+
+Adafruit_MotorShield AFMS = Adafruit_MotorShield();
+Engine engine(&AFMS);
+Adafruit_BNO055 sensor;
+Engine::Calibration cal;
+
+// Average yaw rate over ms milliseconds. Positive is counterclockwise.
+double measureYawRate(uint16_t ms)
+{
+    double sum = 0;
+    int n = 0;
+    uint32_t end = millis() + ms;
+    while (millis() < end)
+    {
+        sum += sensor.getVector(Adafruit_BNO055::VECTOR_GYROSCOPE).z();
+        ++n;
+        delay(10);
+    }
+    return sum / n;
+}
+
+// Drive straight at 12 bit velocity speed, and return the normalized yaw
+// rate: positive when the right side runs faster than the left side.
+double driveAndMeasure(int speed)
+{
+    engine.setVelocity(speed, 0);
+    engine.update();
+    delay(settle_ms);
+    double rate = measureYawRate(measure_ms);
+    engine.halt();
+    delay(settle_ms);
+    return speed < 0 ? -rate : rate;
+}
+
+// Find the largest PWM value at which motor name does not move the robot
+uint16_t findDeadband(DCMotorName name)
+{
+    Adafruit_DCMotor* motor = AFMS.getMotor(name);
+    uint16_t pwm = 0;
+
+    motor->run(FORWARD);
+    while (pwm + deadband_step <= Engine::max_speed)
+    {
+        motor->setSpeed12(pwm + deadband_step);
+        delay(settle_ms);
+        if (fabs(measureYawRate(measure_ms)) > moving_rate)
+            break;
+        pwm += deadband_step;
+    }
+    motor->run(RELEASE);
+    delay(settle_ms);
+
+    return pwm;
+}
+
+// Find the gains for both motors at calibration point i
+void findGain(uint8_t i)
+{
+    int speed = min(i << Engine::calibration_shift, int(Engine::max_speed));
+
+    cal.gain[0][i] = cal.gain[1][i] = Engine::unit_gain;
+    engine.setCalibration(cal);
+    double rate = driveAndMeasure(speed);
+    if (fabs(rate) < straight_rate)
+        return;
+
+    // Slow down the faster motor
+    uint8_t fast = rate > 0 ? 1 : 0;
+    uint16_t lo = Engine::unit_gain / 2, hi = Engine::unit_gain;
+    for (uint8_t it = 0; it < gain_iterations; ++it)
+    {
+        cal.gain[fast][i] = (lo + hi) / 2;
+        engine.setCalibration(cal);
+        // Alternate directions, so that the robot stays in place
+        rate = driveAndMeasure(it % 2 ? speed : -speed);
+        if ((rate > 0) == (fast == 1))
+            hi = cal.gain[fast][i];
+        else
+            lo = cal.gain[fast][i];
+    }
+    cal.gain[fast][i] = (lo + hi) / 2;
+}
+
+void printCalibration()
+{
+    for (uint8_t m = 0; m < 2; ++m)
+    {
+        Serial.print(m == 0 ? "left  deadband: " : "right deadband: ");
+        Serial.print(cal.deadband[m]);
+        Serial.print(", gains:");
+        for (uint8_t i = 0; i < Engine::calibration_points; ++i)
+        {
+            Serial.print(' ');
+            Serial.print(cal.gain[m][i]);
+        }
+        Serial.println();
+    }
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    AFMS.begin();
+
+    uint8_t calib_data[NUM_BNO055_OFFSET_REGISTERS];
+    if (!sensor.begin())
+    {
+        Serial.println("No BNO055 sensor found");
+        return;
+    }
+    if (EEPromLayout::read<EEPromLayout::BNO055Calibration>(calib_data, sizeof(calib_data)) == sizeof(calib_data))
+        sensor.setSensorOffsets(calib_data);
+
+    Serial.println("Keep the robot still, waiting for gyroscope calibration");
+    uint8_t gyro = 0;
+    while (gyro < 3)
+    {
+        sensor.getCalibration(nullptr, &gyro, nullptr, nullptr);
+        delay(100);
+    }
+
+    Serial.println("Measuring deadbands");
+    cal.deadband[0] = findDeadband(DC_MOTOR_1);
+    cal.deadband[1] = findDeadband(DC_MOTOR_2);
+
+    Serial.println("Measuring gains");
+    for (uint8_t i = 1; i < Engine::calibration_points; ++i)
+        findGain(i);
+    cal.gain[0][0] = cal.gain[0][1];
+    cal.gain[1][0] = cal.gain[1][1];
+
+    engine.setCalibration(cal);
+    printCalibration();
+    if (engine.saveCalibration())
+        Serial.println("Calibration stored in EEPROM");
+    else
+        Serial.println("Failed to write calibration to EEPROM");
+}
+
+void loop()
+{
+}
@@ -0,0 +1 @@
+../bno055.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../bno055.h
\ No newline at end of file
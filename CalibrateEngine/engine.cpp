@@ -0,0 +1 @@
+../engine.cpp
\ No newline at end of file
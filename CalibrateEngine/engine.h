@@ -0,0 +1 @@
+../engine.h
\ No newline at end of file
@@ -0,0 +1 @@
+../motorshield.h
\ No newline at end of file
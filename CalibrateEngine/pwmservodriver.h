@@ -0,0 +1 @@
+../pwmservodriver.h
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "bno055.h"
+#include "engine.h"
+#include "eyes.h"
+#include "settings.h"
+#include "song.h"
+#include "synth.h"
+#include "timer1tick.h"
+
+// Cycle counting benchmarks of the robot code, to be run under simavr by
+// host/cyclebench, which counts the CPU cycles between writes to GPIOR0.
+// Every benchmark first prints "<number> <name>" on the serial port. Each
+// call is then preceded by writing the benchmark number to GPIOR0 and
+// followed by writing zero. Writing done_marker ends the run. The first
+// benchmark measures the cost of the markers themselves.
+
+const uint8_t done_marker = 0xff;
+// Number of calls for benchmarks without a natural period
+const uint16_t default_calls = 64;
+
+constexpr char bench_tune[] PROGMEM = "AGECDBFcAGECDBFc";
+
+Adafruit_MotorShield AFMS = Adafruit_MotorShield();
+Engine engine(&AFMS);
+Adafruit_BNO055 sensor;
+Synth synth;
+Song song = Song::compile<bench_tune, 100, 7>(&synth);
+Eyes eyes;
+
+volatile bool update_engine_now = false;
+
+// The timer1 handler of Robot.ino, without the HAL calls
+ISR(TIMER1_COMPA_vect)
+{
+    if (timer1Tick(eyes))
+        update_engine_now = true;
+}
+
+// Same body as the timer2 handler in Robot.ino
+ISR(TIMER2_OVF_vect)
+{
+    synth.tick();
+}
+
+// Prevent the compiler from optimizing away the computation of value
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Make the compiler forget what it knows about value, without moving it to memory
+template <typename T>
+inline void clobber(T& value)
+{
+    asm volatile("" : "+r"(value) : : "memory");
+}
+
+inline void mark(uint8_t value)
+{
+    asm volatile("" : : : "memory");
+    GPIOR0 = value;
+    asm volatile("" : : : "memory");
+}
+
+// Announce benchmark number id, and wait until the announcement is sent so
+// that the serial interrupt does not disturb the measurement
+void announce(uint8_t id, const char* name)
+{
+    Serial.print(id);
+    Serial.print(' ');
+    Serial.println(name);
+    Serial.flush();
+}
+
+void benchOverhead(uint8_t id)
+{
+    announce(id, "overhead");
+    for (uint16_t i = 0; i < default_calls; ++i)
+    {
+        mark(id);
+        mark(0);
+    }
+}
+
+void benchTimer1Isr(uint8_t id)
+{
+    announce(id, "timer1_isr");
+    // Cover a full period of the infrared measurements. Calling the handler
+    // directly leaves out the interrupt response and the jump in the vector
+    // table, 7 cycles together.
+    for (uint16_t i = 0; i < 2 * IR_trigger_ticks; ++i)
+    {
+        mark(id);
+        TIMER1_COMPA_vect();
+        mark(0);
+    }
+}
+
+void benchTimer2Isr(uint8_t id)
+{
+    announce(id, "timer2_isr");
+    // Play a chord, with the handler called here instead of by the timer, so
+    // that the calls can be marked
+    for (uint8_t v = 0; v < Synth::nr_voices; ++v)
+        synth.noteOn(v, 440 + 110*v, 60000);
+    TIMSK2 = 0;
+    // Cover a full round of envelope updates. Three out of four calls only
+    // count the overflow, the mean is the cost per overflow.
+    for (uint16_t i = 0; i < Synth::overflows_per_sample * Synth::envelope_interval; ++i)
+    {
+        mark(id);
+        TIMER2_OVF_vect();
+        mark(0);
+    }
+    for (uint8_t v = 0; v < Synth::nr_voices; ++v)
+        synth.noteOff(v);
+}
+
+void benchInfraredTick(uint8_t id)
+{
+    announce(id, "Eyes::infraredTick");
+    Eyes* e = &eyes;
+    for (uint16_t i = 0; i < 2 * IR_trigger_ticks; ++i)
+    {
+        clobber(e);
+        mark(id);
+        e->infraredTick();
+        mark(0);
+    }
+}
+
+void benchInfraredVoltToCm(uint8_t id)
+{
+    announce(id, "Eyes::infraredVoltToCm");
+    for (uint16_t i = 0; i < default_calls; ++i)
+    {
+        // Sweep the range the conversion is computed for
+        unsigned int v = 60 + i * (600 - 60) / default_calls;
+        clobber(v);
+        mark(id);
+        unsigned int cm = Eyes::infraredVoltToCm(v);
+        doNotOptimize(cm);
+        mark(0);
+    }
+}
+
+void benchSongUpdate(uint8_t id)
+{
+    announce(id, "Song::update");
+    Song* s = &song;
+    s->start();
+    uint32_t now = millis();
+    for (uint16_t i = 0; i < 16 * default_calls; ++i)
+    {
+        // Advance 1 ms per call, like a fast main loop
+        ++now;
+        clobber(s);
+        clobber(now);
+        mark(id);
+        s->update(now);
+        mark(0);
+        if (s->finished())
+            s->start();
+    }
+}
+
+void benchEngineTurn(uint8_t id)
+{
+    announce(id, "Engine::turn");
+    for (uint16_t i = 0; i < default_calls; ++i)
+    {
+        int speed = int(i * 8) - 255, turn_speed = int(255 - i * 8);
+        clobber(speed);
+        clobber(turn_speed);
+        mark(id);
+        engine.turn(speed, turn_speed);
+        mark(0);
+    }
+    engine.halt();
+}
+
+void benchToEuler(uint8_t id)
+{
+    announce(id, "Quaternion::toEuler");
+    imu::Quaternion q(0.9238795, 0.0, 0.0, 0.3826834);
+    imu::Quaternion* p = &q;
+    for (uint16_t i = 0; i < default_calls; ++i)
+    {
+        clobber(p);
+        mark(id);
+        imu::Vector<3> euler = p->toEuler();
+        doNotOptimize(euler);
+        mark(0);
+    }
+}
+
+void benchGetVector(uint8_t id)
+{
+    announce(id, "Adafruit_BNO055::getVector");
+    Adafruit_BNO055* s = &sensor;
+    for (uint16_t i = 0; i < default_calls; ++i)
+    {
+        clobber(s);
+        mark(id);
+        imu::Vector<3> v = s->getVector(Adafruit_BNO055::VECTOR_EULER);
+        doNotOptimize(v);
+        mark(0);
+    }
+}
+
+void (* const benchmarks[])(uint8_t id) = {
+    benchOverhead,
+    benchTimer1Isr,
+    benchTimer2Isr,
+    benchInfraredTick,
+    benchInfraredVoltToCm,
+    benchSongUpdate,
+    benchEngineTurn,
+    benchToEuler,
+    benchGetVector
+};
+
+void setup()
+{
+    Serial.begin(115200);
+    AFMS.begin();
+
+    // Stop the millis() interrupt, so that it does not disturb the
+    // measurements. Song::update() gets the time as an argument.
+    TIMSK0 &= ~(1 << TOIE0);
+
+    for (uint8_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+        benchmarks[i](i + 1);
+    mark(done_marker);
+}
+
+void loop()
+{
+}
@@ -0,0 +1 @@
+../motorshield.cpp
\ No newline at end of file
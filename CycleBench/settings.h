@@ -0,0 +1 @@
+../settings.h
\ No newline at end of file
@@ -0,0 +1 @@
+../song.cpp
\ No newline at end of file
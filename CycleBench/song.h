@@ -0,0 +1 @@
+../song.h
\ No newline at end of file
@@ -0,0 +1 @@
+../songcompiler.h
\ No newline at end of file
@@ -0,0 +1 @@
+../synth.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../synth.h
\ No newline at end of file
@@ -0,0 +1 @@
+../timer1tick.h
\ No newline at end of file
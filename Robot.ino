@@ -1,17 +1,20 @@
+#include "blackbox.h"
+#include "eepromlog.h"
 #include "engine.h"
 #include "eyes.h"
+#include "latencyhistogram.h"
+#include "navsettings.h"
 #include "positionsensor.h"
 #include "settings.h"
 #include "song.h"
+#include "synth.h"
+#include "telemetry.h"
+#include "timer1tick.h"
+#include "tunables.h"
+#include "hal.h"
 
 const bool debug = true;
 
-// Minimum distance from walls for full speed cruising
-const int min_cruise_dist = 80;
-// Minimum distance to wall, soft and hard limits
-const int min_dist_soft = 20;
-const int min_dist_hard = 15;
-
 // Create the motor shield object with the default I2C address 0x60
 Adafruit_MotorShield AFMS = Adafruit_MotorShield();
 Engine engine(&AFMS);
@@ -19,27 +22,100 @@ Engine engine(&AFMS);
 // Create the position sensor object with the default I2C address 0x28
 PositionSensor pos_sensor;
 
-const char r2d2_desc[] PROGMEM = "AGECDBFcAGECDBFc";
-const char popcorn_desc[] PROGMEM = "aGaECEA,zaGaECEA,zabc'bc'ababgagafaz";
-Song r2d2_song(r2d2_desc, 100, 7);
-Song popcorn_song(popcorn_desc);
+constexpr char r2d2_desc[] PROGMEM = "AGECDBFcAGECDBFc";
+constexpr char popcorn_desc[] PROGMEM = "aGaECEA,zaGaECEA,zabc'bc'ababgagafaz";
+Synth synth;
+Song r2d2_song = Song::compile<r2d2_desc, 100, 7>(&synth);
+Song popcorn_song = Song::compile<popcorn_desc>(&synth);
 Song* current_song = nullptr;
 
 Eyes eyes;
+EEPromLog eeprom_log;
+BlackBox black_box(eeprom_log);
+Telemetry telemetry;
+// Control loop telemetry: distance, state, left and right speed, and the
+// center, left and right infrared distances
+Telemetry::Channel control_telemetry(1, 7);
+// Latency from sampling the infrared sensors to the motor command based on
+// the sample reaching the motor shield, sent every latency_report_ms
+LatencyHistogram command_latency;
+Telemetry::Channel latency_telemetry(3, LatencyHistogram::nr_bins);
+const uint16_t latency_report_ms = 1000;
+
+// Parameters that can be changed over the serial port. The navigation
+// parameters are declared in navsettings.h.
+int min_cruise_dist = min_cruise_dist_default;
+int min_dist_soft = min_dist_soft_default;
+int min_dist_hard = min_dist_hard_default;
+int cruise_speed = cruise_speed_default;
+int approach_speed = approach_speed_default;
+int turn_speed = turn_speed_default;
+int turn_sharpness = turn_sharpness_default;
+int field_steering = field_steering_default;
+int field_range = field_range_default;
+int field_gain = field_gain_default;
+int accel = engine_accel;
+int decel = engine_decel;
+int brake_ms = engine_brake_ms;
+int ir_ticks = IR_trigger_ticks;
+int pwm_freq = motor_pwm_freq;
+
+#define TUNABLE_NAME(var) constexpr char var##_name[] PROGMEM = #var
+TUNABLE_NAME(min_cruise_dist);
+TUNABLE_NAME(min_dist_soft);
+TUNABLE_NAME(min_dist_hard);
+TUNABLE_NAME(cruise_speed);
+TUNABLE_NAME(approach_speed);
+TUNABLE_NAME(turn_speed);
+TUNABLE_NAME(turn_sharpness);
+TUNABLE_NAME(field_steering);
+TUNABLE_NAME(field_range);
+TUNABLE_NAME(field_gain);
+TUNABLE_NAME(accel);
+TUNABLE_NAME(decel);
+TUNABLE_NAME(brake_ms);
+TUNABLE_NAME(ir_ticks);
+TUNABLE_NAME(pwm_freq);
+
+// Replies are indexed by position in this table, see tools/teledecode
+const Tunables::Tunable tunable_table[] PROGMEM = {
+    { min_cruise_dist_name, &min_cruise_dist, 1, 500 },
+    { min_dist_soft_name, &min_dist_soft, 0, 500 },
+    { min_dist_hard_name, &min_dist_hard, 0, 499 },
+    { cruise_speed_name, &cruise_speed, 0, 255 },
+    { approach_speed_name, &approach_speed, 0, 255 },
+    { turn_speed_name, &turn_speed, 0, 255 },
+    { turn_sharpness_name, &turn_sharpness, 0, 255 },
+    { field_steering_name, &field_steering, 0, 1 },
+    { field_range_name, &field_range, 1, 200 },
+    { field_gain_name, &field_gain, 0, 1024 },
+    { accel_name, &accel, 1, Engine::max_speed },
+    { decel_name, &decel, 1, Engine::max_speed },
+    { brake_ms_name, &brake_ms, 0, 1000 },
+    // Between 1 ms and 1 s
+    { ir_ticks_name, &ir_ticks, 1000 / timer1_us, 1000000ul / timer1_us },
+    // The range of the PCA9685, with setPWMFreq()'s correction
+    { pwm_freq_name, &pwm_freq, 30, 1600 }
+};
+// Key of the saved parameters in the EEPROM log
+const uint8_t tunables_key = 0;
+Tunables tunables(tunable_table, sizeof(tunable_table) / sizeof(tunable_table[0]),
+    eeprom_log, tunables_key, telemetry, 2);
 
-volatile bool update_music_now = false;
+volatile bool update_engine_now = false;
 
 enum DriveState
 {
     CRUISING,
+    BRAKING,
     TURNING,
     HALT
 };
 
 void setupTimer(long us)
 {
-    // timer0 used for millis() and delay(), timer2 for tone. That leaves us
-    // timer1
+    // timer0 used for millis() and delay(), timer2 for the synthesizer. That
+    // leaves us timer1
     static const uint16_t max_cycles = 0xffff; // counter for timer1 is 16bit
 
     uint32_t cycles = uint32_t(us) * (F_CPU / 1000000);
@@ -56,16 +132,6 @@ void setupTimer(long us)
         bits |= (1 << CS12) | (1 << CS10);// prescaler = 1024;
     // else timeout to large, disable timer
 
-    if (debug)
-    {
-        Serial.print("interval = ");
-        Serial.print(us);
-        Serial.print(", bits = ");
-        Serial.print((bits ^ (1 << WGM12)), 2);
-        Serial.print(", cycles = ");
-        Serial.println(cycles);
-    }
-
     noInterrupts();
 
     TCCR1A = 0;              // clear TCCR1A register
@@ -77,11 +143,82 @@ void setupTimer(long us)
     interrupts();
 }
 
-void updateMusic()
+void recordFrame(const Eyes& seen, uint8_t state, uint32_t now)
+{
+    static uint32_t last_frame = 0;
+
+    BlackBox::Frame frame;
+    for (uint8_t i = 0; i < Eyes::IR_COUNT; ++i)
+        frame.dist[i] = min(seen.infraredDistance(Eyes::IRSensorNumber(i)), uint16_t(255));
+    frame.state = state;
+    frame.speed_left = engine.speedLeft() / 32;
+    frame.speed_right = engine.speedRight() / 32;
+    // The position sensor is not read in the control loop (yet)
+    frame.heading = 0;
+    frame.loop_ms = min(now - last_frame, uint32_t(255));
+    black_box.record(frame);
+    last_frame = now;
+}
+
+/**
+ * Steer around obstacles
+ *
+ * Compute the speed and turning speed that steer the robot away from the
+ * obstacles seen in \a seen, while it keeps moving. Every infrared reading
+ * closer than field_range pushes the robot away from it, with a force
+ * growing linearly as the obstacle gets closer. The sideways forces set the
+ * turning speed, the forces from the front slow the robot down, from
+ * cruise_speed to approach_speed. An obstacle straight ahead pushes toward
+ * the side with the most room.
+ */
+void fieldSteering(const Eyes& seen, int& speed, int& turn)
+{
+    int push[Eyes::IR_COUNT];
+    for (uint8_t i = 0; i < Eyes::IR_COUNT; ++i)
+        push[i] = max(field_range - int(seen.infraredDistance(Eyes::IRSensorNumber(i))), 0);
+
+    // The side sensors look 45 degrees to the side; cos 45° = 181/256
+    int side = push[Eyes::IR_LEFT] - push[Eyes::IR_RIGHT];
+    int front = push[Eyes::IR_LEFT] + push[Eyes::IR_RIGHT];
+    long sideways = long(side) * 181 / 256 + seen.turnDirection() * push[Eyes::IR_CENTER];
+    int ahead = push[Eyes::IR_CENTER] + long(front) * 181 / 256;
+
+    // Never turn in place while steering, that is left to the dead end handling
+    turn = constrain(sideways * field_gain / field_range, -128, 128);
+    speed = cruise_speed - long(cruise_speed - approach_speed) * min(ahead, field_range)
+        / field_range;
+}
+
+/// Apply the parameters that are not read directly by the control loop
+void applyTunables()
+{
+    engine.setAcceleration(accel, decel);
+    noInterrupts();
+    eyes.setInfraredInterval(ir_ticks);
+    interrupts();
+    // Changing the frequency stops the motors briefly, so only do it when needed
+    if (uint16_t(pwm_freq) != AFMS.pwmFreq())
+        AFMS.setPWMFreq(pwm_freq);
+}
+
+/**
+ * Count the latency of the last control decision in command_latency, once
+ * the motor shield has been written to since \a transactions.
+ */
+void countCommandLatency(bool& pending, uint32_t sample_us, uint32_t transactions)
+{
+    if (pending && AFMS.driver().transactions() != transactions)
+    {
+        command_latency.add(micros() - sample_us);
+        pending = false;
+    }
+}
+
+void updateMusic(uint32_t now)
 {
     if (current_song)
     {
-        current_song->update();
+        current_song->update(now);
         if (current_song->finished())
         {
             popcorn_song.start();
@@ -92,34 +229,50 @@ void updateMusic()
 
 ISR(TIMER1_COMPA_vect)
 {
-    static uint16_t cur_music_tick = 1;
-
-    // Update music
-    if (--cur_music_tick == 0)
+    HAL_ISR(TIMER1_COMPA);
+    if (timer1Tick(eyes))
     {
-        cur_music_tick = music_ticks;
-        update_music_now = true;
+        update_engine_now = true;
+        HAL_ISR_EVENT();
     }
+}
 
-//    eyes.ultrasoundTick();
-    eyes.infraredTick();
+ISR(TIMER2_OVF_vect)
+{
+    synth.tick();
+}
+
+ISR(EE_READY_vect)
+{
+    HAL_ISR(EE_READY);
+    // Every invocation changes the write queue, which the main program reads
+    HAL_ISR_EVENT();
+    eeprom_log.eepromReady();
 }
 
 void setup()
 {
+    HAL_BEGIN();
     if (debug)
-        Serial.begin(9600);
+        telemetry.begin();
 
 //    pinMode(US_trigger_pin, OUTPUT);
 //    pinMode(US_echo_pin, INPUT);
-    pinMode(piezo_pin, OUTPUT);
+
+    eeprom_log.begin();
+    tunables.load();
+    eyes.setInfraredInterval(ir_ticks);
 
     setupTimer(timer1_us);
 
 //    attachInterrupt(digitalPinToInterrupt(US_echo_pin),
 //        []() { eyes.handleUltrasoundEcho(); }, CHANGE);
 
-    AFMS.begin();  // create with the default frequency 1.6KHz
+    AFMS.begin(pwm_freq);
+    engine.setAcceleration(accel, decel);
+    engine.loadCalibration();
+
+    synth.begin();
 
     r2d2_song.start();
     //current_song = &r2d2_song;
@@ -128,64 +281,162 @@ void setup()
 void loop()
 {
     static DriveState state = HALT;
-    static uint8_t speed = 0;
     static uint32_t sleep_until = 0;
+    static bool collided = false;
+    static uint8_t last_frame = 0;
+    static uint32_t last_report = 0;
+    // Latency measurement of the control decisions: whether a motor command
+    // is still to be written, and for the first decision since the last
+    // command was written, the time the oldest sensor data it was based on
+    // was sampled and the number of shield transactions before it
+    static bool command_pending = false;
+    static uint32_t sample_us = 0;
+    static uint32_t transactions = 0;
+    // Whether the engine was updated for a decision since the last timer
+    // update, see below
+    static bool skip_update = false;
 
     uint32_t now = millis();
 
-    if (update_music_now)
+    if (debug)
     {
-        update_music_now = false;
-        updateMusic();
+        telemetry.poll();
+        Tunables::Result command = tunables.poll(now);
+        if (command == Tunables::CHANGED)
+            applyTunables();
+        else if (command == Tunables::OTHER && strcmp(tunables.command(), "B") == 0)
+            black_box.save();
+
+        if (now - last_report >= latency_report_ms)
+        {
+            telemetry.send(latency_telemetry, now, command_latency.counts());
+            command_latency.clear();
+            last_report = now;
+        }
+    }
+    eeprom_log.poll();
+    black_box.poll();
+    updateMusic(now);
+
+    noInterrupts();
+    HAL_SYNC();
+    bool update_engine = update_engine_now;
+    update_engine_now = false;
+    interrupts();
+    if (update_engine && skip_update)
+    {
+        skip_update = false;
+    }
+    else if (update_engine)
+    {
+        engine.update();
+        countCommandLatency(command_pending, sample_us, transactions);
     }
 
     if (now < sleep_until)
         return;
 
-    uint16_t dist = eyes.distance();
-    if (debug)
+    // Make a control decision for every new infrared measurement, so that
+    // decisions are made as soon as new data arrives, and never twice on the
+    // same data. Take a consistent copy of the distances measured in the
+    // timer interrupt.
+    noInterrupts();
+    HAL_SYNC();
+    if (eyes.frame() == last_frame)
     {
-        Serial.print("dist = ");
-        Serial.println(dist);
+        interrupts();
+        return;
     }
-    sleep_until = now + 10;
-    if (dist > min_cruise_dist)
+    Eyes seen = eyes;
+    interrupts();
+    last_frame = seen.frame();
+
+    int target_left = engine.targetLeft();
+    int target_right = engine.targetRight();
+    uint32_t decision_transactions = AFMS.driver().transactions();
+    uint16_t dist = seen.distance();
+    bool forward = engine.speedLeft() > 0 && engine.speedRight() > 0;
+    if (field_steering && (dist > min_dist_hard || (state == CRUISING && dist > min_dist_soft)))
     {
-        if (speed < 255)
-            engine.moveForward(++speed);
+        // Steer around obstacles while moving; only in dead ends, stop and
+        // turn in place below
+        int speed, turn;
+        fieldSteering(seen, speed, turn);
+        engine.setTargetTurn(speed, turn);
+        state = CRUISING;
+    }
+    else if (dist > min_cruise_dist)
+    {
+        engine.setTargetSpeed(cruise_speed);
     }
     else if (dist > min_dist_hard || (state == CRUISING && dist > min_dist_soft))
     {
-        uint8_t new_speed = 50 + (255 - 50) * (dist - min_dist_hard)
-                                    / (min_cruise_dist - min_dist_hard);
-        if (new_speed != speed)
-        {
-            speed = new_speed;
-            engine.moveForward(speed);
-        }
+        // Between the soft and hard limits, keep going at the approach speed
+        int over = max(int(dist) - min_dist_hard, 0);
+        uint8_t speed = approach_speed + long(cruise_speed - approach_speed)
+            * over / max(min_cruise_dist - min_dist_hard, 1);
+        engine.setTargetSpeed(speed);
         state = CRUISING;
     }
-    else
+    else if (state == CRUISING)
     {
-        if (speed > 0)
-        {
-            speed = 0;
-            engine.halt();
-        }
-        if (state != TURNING)
-        {
-            engine.turn(128, 255*eyes.turnDirection());
-            state = TURNING;
-        }
+        // Brake hard first, rather than slowly turning into the wall
+        engine.stop(brake_ms);
+        state = BRAKING;
+        sleep_until = now + brake_ms;
+    }
+    else if (state != TURNING)
+    {
+        engine.setTargetTurn(turn_speed, turn_sharpness*seen.turnDirection());
+        state = TURNING;
+    }
+
+    // Only decisions that change the targets or brake issue a command.
+    // Braking writes the motor shield right away; new target speeds are
+    // written by an engine update right here, unless they are reached
+    // already. The next timer update is skipped instead, so that the speeds
+    // still change at most once per engine tick on average.
+    bool retarget = engine.targetLeft() != target_left || engine.targetRight() != target_right;
+    bool command = retarget || AFMS.driver().transactions() != decision_transactions;
+    if (command && !command_pending)
+    {
+        command_pending = true;
+        sample_us = seen.sampleTime();
+        transactions = decision_transactions;
     }
+    if (retarget && !engine.atTarget())
+    {
+        engine.update();
+        skip_update = true;
+    }
+    countCommandLatency(command_pending, sample_us, transactions);
+    if (engine.atTarget())
+        command_pending = false;
 
-//     if (debug)
-//     {
-//         Serial.print("dist = ");
-//         Serial.print(dist);
-//         Serial.print(", state = ");
-//         Serial.print(state);
-//         Serial.print(", speed = ");
-//         Serial.println(speed);
-//     }
+    recordFrame(seen, state, now);
+    if (debug)
+    {
+        int16_t sample[] = {
+            int16_t(dist), state, int16_t(engine.speedLeft()), int16_t(engine.speedRight()),
+            int16_t(seen.infraredDistance(Eyes::IR_CENTER)),
+            int16_t(seen.infraredDistance(Eyes::IR_LEFT)),
+            int16_t(seen.infraredDistance(Eyes::IR_RIGHT))
+        };
+        telemetry.send(control_telemetry, now, sample);
+    }
+    // The IR sensors report 0 when an obstacle is closer than they can
+    // measure. That also happens when turning close to a wall, so only
+    // driving into it counts as a collision, and the next one only counts
+    // once the robot got clear of the obstacle.
+    uint16_t center = seen.infraredDistance(Eyes::IR_CENTER);
+    if (center == 0 && forward && !collided)
+    {
+        engine.brake();
+        black_box.save();
+        collided = true;
+    }
+    else if (center > min_dist_soft)
+    {
+        collided = false;
+    }
 }
@@ -0,0 +1,103 @@
+#include "eepromlayout.h"
+#include "engine.h"
+#include "eyes.h"
+#include "settings.h"
+
+// Distance to the wall (cm) at which the robot is stopped
+const uint16_t stop_dist = 60;
+// Speed (0-255) at which the robot approaches the wall
+const uint8_t approach_speed = 255;
+// Time to let the robot come to a standstill after stopping, in ms
+const uint16_t settle_ms = 1000;
+// Interval between distance measurements, in ms. The Sharp IR sensors update
+// their output about every 40 ms.
+const uint16_t sample_ms = 40;
+// Number of distance measurements to average when standing still
+const uint8_t nr_samples = 8;
+
+Adafruit_MotorShield AFMS = Adafruit_MotorShield();
+Engine engine(&AFMS);
+Eyes eyes;
+
+// Measure all IR sensors, and return the smallest distance
+uint16_t measure()
+{
+    eyes.infraredMeasure(Eyes::IR_CENTER);
+    eyes.infraredMeasure(Eyes::IR_LEFT);
+    eyes.infraredMeasure(Eyes::IR_RIGHT);
+    return eyes.distance();
+}
+
+// Average distance over nr_samples measurements
+uint16_t measureStill()
+{
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < nr_samples; ++i)
+    {
+        sum += measure();
+        delay(sample_ms);
+    }
+    return sum / nr_samples;
+}
+
+// Drive toward the wall, stop by coasting or braking, and report the
+// distance travelled after the stop command.
+void run(bool brake)
+{
+    uint16_t start = measureStill();
+    if (start <= stop_dist)
+    {
+        Serial.println("Too close to the wall, move the robot back");
+        return;
+    }
+
+    engine.moveForward(approach_speed);
+    uint32_t t0 = millis();
+    uint16_t dist;
+    do
+    {
+        delay(sample_ms);
+        dist = measure();
+    }
+    while (dist > stop_dist);
+    uint32_t t_stop = millis();
+
+    if (brake)
+        engine.stop(engine_brake_ms);
+    else
+        engine.halt();
+    while (millis() - t_stop < settle_ms)
+        engine.update();
+    uint16_t end = measureStill();
+
+    Serial.print(brake ? "brake" : "coast");
+    Serial.print(": approach ");
+    Serial.print(start - dist);
+    Serial.print(" cm in ");
+    Serial.print(t_stop - t0);
+    Serial.print(" ms, stopped at ");
+    Serial.print(dist);
+    Serial.print(" cm, stopping distance ");
+    Serial.print(int(dist) - int(end));
+    Serial.println(" cm");
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    AFMS.begin();
+    engine.loadCalibration();
+
+    Serial.println("Place the robot facing a wall, more than a metre away.");
+    Serial.println("Send 'c' to measure coasting, 'b' to measure braking.");
+}
+
+void loop()
+{
+    if (!Serial.available())
+        return;
+
+    int c = Serial.read();
+    if (c == 'c' || c == 'b')
+        run(c == 'b');
+}
@@ -0,0 +1 @@
+../eyes.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../eyes.h
\ No newline at end of file
@@ -0,0 +1 @@
+../pwmservodriver.cpp
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "blackbox.h"
+
+namespace
+{
+
+inline uint8_t bitCount(uint8_t mask)
+{
+    uint8_t n = 0;
+    for ( ; mask; mask &= mask - 1)
+        ++n;
+    return n;
+}
+
+} // namespace
+
+void BlackBox::record(const Frame& frame)
+{
+    // The ring must not change under a save
+    if (saving())
+        return;
+
+    const uint8_t* fields = reinterpret_cast<const uint8_t*>(&frame);
+
+    uint8_t mask = keyframe;
+    if (!_empty && _since_keyframe < keyframe_interval)
+    {
+        mask = 0;
+        for (uint8_t i = 0; i < nr_fields; ++i)
+        {
+            if (fields[i] != _prev[i])
+                mask |= 1 << i;
+        }
+    }
+
+    // A delta frame needs a preceding frame in the ring to apply to
+    if (mask != keyframe)
+    {
+        _makeRoom(1 + bitCount(mask));
+        if (_used == 0)
+            mask = keyframe;
+    }
+
+    // A frame in which every field changed is stored as a key frame
+    if (mask == keyframe)
+    {
+        _makeRoom(1 + nr_fields);
+        _push(keyframe);
+        for (uint8_t i = 0; i < nr_fields; ++i)
+            _push(fields[i]);
+        _since_keyframe = 0;
+    }
+    else
+    {
+        _push(mask);
+        for (uint8_t i = 0; i < nr_fields; ++i)
+        {
+            if (mask & (1 << i))
+                _push(fields[i] - _prev[i]);
+        }
+        ++_since_keyframe;
+    }
+
+    memcpy(_prev, fields, nr_fields);
+    _empty = false;
+}
+
+void BlackBox::save()
+{
+    if (saving())
+        return;
+
+    _save_pos = 0;
+    _save_end = EEPromLayout::magic_len + 2 + _used;
+}
+
+void BlackBox::poll()
+{
+    typedef EEPromLayout::BlackBoxRecording Item;
+
+    if (!saving() || _log.pending())
+        return;
+
+    uint8_t chunk[save_chunk];
+    uint8_t len = min(uint16_t(_save_end - _save_pos), uint16_t(save_chunk));
+    for (uint8_t i = 0; i < len; ++i)
+        chunk[i] = _itemByte(_save_pos + i);
+    if (_log.writeAt(Item::offset + _save_pos, chunk, len))
+        _save_pos += len;
+}
+
+uint8_t BlackBox::_itemByte(uint16_t pos) const
+{
+    typedef EEPromLayout::BlackBoxRecording Item;
+
+    // The magic, the number of recorded bytes, then the frames
+    if (pos < EEPromLayout::magic_len)
+        return Item::magic >> (8 * pos);
+    pos -= EEPromLayout::magic_len;
+    if (pos < 2)
+        return _used >> (8 * pos);
+    return _ring[uint8_t(_start + pos - 2)];
+}
+
+uint8_t BlackBox::_frameSize(uint8_t pos) const
+{
+    uint8_t mask = _ring[pos];
+    return 1 + (mask == keyframe ? nr_fields : bitCount(mask));
+}
+
+void BlackBox::_makeRoom(uint8_t size)
+{
+    if (ring_size - _used >= size)
+        return;
+
+    // Drop frames until there is room, and the oldest frame is a key frame
+    do
+    {
+        uint8_t drop = _frameSize(_start);
+        _start += drop;
+        _used -= drop;
+    }
+    while (_used > 0 && (ring_size - _used < size || _ring[_start] != keyframe));
+}
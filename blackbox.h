@@ -0,0 +1,135 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <Arduino.h>
+#include "eepromlog.h"
+
+/**
+ * Class for recording the recent control state
+ *
+ * Class BlackBox keeps a record of the last few seconds of the robot's
+ * control state in a ring buffer in SRAM, so that the events leading up to a
+ * collision can be examined afterwards. On a collision, or on command, the
+ * ring is copied to EEPROM with save(), from where it can be read out with
+ * the BlackBoxDump sketch, and decoded on the host with tools/bbdecode.
+ *
+ * Saving does not block: poll() hands the recording to the background writer
+ * of EEPromLog in chunks of \c save_chunk bytes, one chunk at a time, so that
+ * the log's own records are not held up. Recording is paused until the whole
+ * ring has been handed over.
+ *
+ * Every frame holds eight byte-sized fields (see Frame). To keep the frames
+ * small, each frame is stored as a mask byte, with one bit set for each
+ * field that changed since the previous frame, followed by the change of
+ * each of these fields modulo 256. A mask of 0xff denotes a key frame, which
+ * holds the values of all fields instead of their changes. Key frames are
+ * stored every \c keyframe_interval frames, and when the oldest frames are
+ * dropped from the ring, the ring always starts at a key frame.
+ *
+ * The recording in EEPROM consists of the number of recorded bytes (two
+ * bytes, little endian), followed by the frames, oldest first.
+ */
+class BlackBox
+{
+public:
+    /// Size of the ring buffer in bytes
+    static const uint16_t ring_size = 256;
+    /// Maximum number of frames between key frames
+    static const uint8_t keyframe_interval = 16;
+    /// Mask byte of a key frame
+    static const uint8_t keyframe = 0xff;
+    /// Number of bytes handed to the EEPROM writer per call to poll()
+    static const uint8_t save_chunk = 16;
+
+    /// Control state recorded in a frame
+    struct Frame
+    {
+        /// Infrared distances (center, left, right) in cm, at most 255
+        uint8_t dist[3];
+        /// State of the drive state machine
+        uint8_t state;
+        /// Speeds of the left and right side, in 12 bit speed units divided by 32
+        int8_t speed_left, speed_right;
+        /// Heading, with 256 units in a full circle
+        uint8_t heading;
+        /// Time since the previous frame in ms, at most 255
+        uint8_t loop_ms;
+    };
+
+    /// Constructor, saving the recording through \a log
+    BlackBox(EEPromLog& log): _log(log), _start(0), _used(0), _since_keyframe(0),
+        _empty(true), _save_pos(0), _save_end(0) {}
+
+    /**
+     * Record a frame
+     *
+     * Add \a frame to the ring buffer, dropping the oldest frames if needed.
+     * Frames are dropped while the recording is being saved. This function
+     * is meant to be called once every control cycle, and takes a few
+     * microseconds.
+     */
+    void record(const Frame& frame);
+    /**
+     * Save the recording
+     *
+     * Start copying the frames in the ring buffer to EEPROM. The copy is made
+     * by poll(); a save already in progress is left to finish.
+     */
+    void save();
+    /**
+     * Continue saving
+     *
+     * Hand the next chunk of a save in progress to the EEPROM writer, if it
+     * has no other writes queued. This function should be called every pass
+     * through loop(), and takes a few microseconds.
+     */
+    void poll();
+    /// Return \c true if a save is in progress
+    bool saving() const { return _save_pos < _save_end; }
+    /// Clear the recording
+    void clear()
+    {
+        _used = 0;
+        _empty = true;
+    }
+
+private:
+    static const uint8_t nr_fields = sizeof(Frame);
+    static_assert(ring_size == 256, "ring positions must wrap around at 256");
+    static_assert(EEPromLayout::BlackBoxRecording::len == 2 + ring_size,
+        "EEPROM item does not match the black box size");
+
+    /// Log through which the recording is saved
+    EEPromLog& _log;
+    /// The ring buffer
+    uint8_t _ring[ring_size];
+    /// Position of the oldest frame in the ring
+    uint8_t _start;
+    /// Number of bytes in use
+    uint16_t _used;
+    /// Number of frames since the last key frame
+    uint8_t _since_keyframe;
+    /// Whether no frame was recorded yet
+    bool _empty;
+    /// The previous frame
+    uint8_t _prev[nr_fields];
+    /// Position in the EEPROM item of the next byte to save, counting the magic
+    uint16_t _save_pos;
+    /// End of the EEPROM item data to save
+    uint16_t _save_end;
+
+    /// Return the byte at position \a pos of the EEPROM item, counting the magic
+    uint8_t _itemByte(uint16_t pos) const;
+    /// Return the size of the frame at position \a pos in the ring
+    uint8_t _frameSize(uint8_t pos) const;
+    /// Drop the oldest frames until at least \a size bytes are free
+    void _makeRoom(uint8_t size);
+    /// Append byte \a b
+    void _push(uint8_t b)
+    {
+        _ring[uint8_t(_start + _used)] = b;
+        ++_used;
+    }
+};
+
+#endif // BLACKBOX_H
@@ -27,6 +27,7 @@
 #include <limits.h>
 
 #include "bno055.h"
+#include "hal.h"
 
 /***************************************************************************
  PUBLIC FUNCTIONS
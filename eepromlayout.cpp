@@ -1,56 +1,64 @@
-#include <EEPROM.h>
-#include <string.h>
+#include <avr/eeprom.h>
 #include "eepromlayout.h"
+#include "hal.h"
 
-const EEPromLayout::ItemInfo EEPromLayout::_layout[_layout_size] = {
-    { {'B', 'N', 'O', 'C'}, 0, 22 }
-};
+namespace
+{
 
-const EEPromLayout::ItemInfo* EEPromLayout::find(const char* magic)
+/**
+ * Wait until the EEPROM ready interrupt is off. EEPromLog writes in the
+ * background from that interrupt, which may change EEAR in the middle of an
+ * eeprom_* function. The interrupt is on while the log has writes queued,
+ * and only the main program queues them, so once it is off it stays off
+ * until the main program goes on.
+ */
+void waitForBackgroundWrites()
 {
-    for (int i = 0; i < _layout_size; ++i)
+    for (;;)
     {
-        if (!memcmp(_layout[i].magic, magic, 4))
-            return _layout + i;
+        noInterrupts();
+        HAL_SYNC();
+        bool busy = EECR & (1 << EERIE);
+        interrupts();
+        if (!busy)
+            return;
     }
-    return nullptr;
 }
 
-int EEPromLayout::read(const char* magic, byte* data, int len)
+} // namespace
+
+int EEPromLayout::_read(int offset, uint32_t magic, int item_len, void* data,
+    int len, int pos)
 {
-    const ItemInfo* info = find(magic);
-    if (!info)
-        return -1;
+    waitForBackgroundWrites();
 
-    int pos = info->offset;
     // check if item is actually stored by checking signature
-    for (int i = 0; i < 4; ++i, ++pos)
+    uint32_t stored;
+    eeprom_read_block(&stored, reinterpret_cast<const void*>(offset), magic_len);
+    if (stored != magic)
+        return -1;
+
+    // Ok, signature is present. Read the data
+    if (pos < item_len)
     {
-        if (EEPROM.read(pos) != magic[i])
-            return -1;
+        eeprom_read_block(data,
+            reinterpret_cast<const void*>(offset + magic_len + pos),
+            min(len, item_len - pos));
     }
 
-    // Ok, signature is rpesent. Read the data
-    for (int i = 0; i < min(len, info->len); ++i, ++pos)
-        data[i] = EEPROM.read(pos);
-
-    return info->len;
+    return item_len;
 }
 
-bool EEPromLayout::write(const char* magic, const byte* data, int len)
+bool EEPromLayout::_write(int offset, uint32_t magic, int item_len,
+    const void* data, int len, int pos)
 {
-    const ItemInfo* info = find(magic);
-    if (!info || info->len < len)
+    if (pos < 0 || item_len < pos + len)
         return false;
 
-    int pos = info->offset;
-    // write signature
-    for (int i = 0; i < 4; ++i, ++pos)
-        EEPROM.update(pos, magic[i]);
-
-    // write the data
-    for (int i = 0; i < len; ++i, ++pos)
-        EEPROM.update(pos, data[i]);
+    waitForBackgroundWrites();
+    eeprom_update_block(&magic, reinterpret_cast<void*>(offset), magic_len);
+    eeprom_update_block(data, reinterpret_cast<void*>(offset + magic_len + pos),
+        len);
 
     return true;
-}
\ No newline at end of file
+}
@@ -3,42 +3,143 @@
 
 #include <Arduino.h>
 
+/// Combine four characters into an EEPROM item identifier, in storage order
+constexpr uint32_t eepromMagic(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8)
+        | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
 /**
  * Class for handling data in EEPromLayout
  *
  * Class EEPromLayout handles the data stored in EEPROM. Each item is of fixed
  * length, is identified by a four byte magic number, and is stored at a
- * specific position in the EEPROM. The table of known items is stored in this
- * class.
+ * specific position in the EEPROM. Items are identified by a tag type, which
+ * holds its magic number, offset, and length, so that item locations are
+ * resolved at compile time. The tags of all known items are listed in
+ * Items, in order of their offset; the compiler checks that items do not
+ * overlap, and that they fit in the region reserved for fixed items.
  */
 class EEPromLayout
 {
 public:
-    /// Type definition of a magic item identifier
-    typedef char Magic[4];
-    /// Definition of a data item stored in EEPROM
-    struct ItemInfo
+    /// End of the region for fixed items. The EEPROM above it is used by EEPromLog.
+    static const int region_end = 384;
+    /// Size of the identifier stored in front of the data of an item
+    static const int magic_len = 4;
+
+    /// Calibration offsets of the BNO055 sensor
+    struct BNO055Calibration
+    {
+        static constexpr uint32_t magic = eepromMagic('B', 'N', 'O', 'C');
+        static const int offset = 0;
+        static const int len = 22;
+    };
+    /// Motor calibration table of the engine
+    struct EngineCalibration
+    {
+        static constexpr uint32_t magic = eepromMagic('E', 'N', 'G', 'C');
+        static const int offset = 26;
+        static const int len = 40;
+    };
+    /// Black box recording, see BlackBox
+    struct BlackBoxRecording
     {
-        /// Identifier for the item
-        const Magic magic;
-        /// Offset of the start of the item in EEPROM
-        int offset;
-        /// The (maximum) number of data bytes in the item. This excludes the identifier
-        int len;
+        static constexpr uint32_t magic = eepromMagic('B', 'B', 'O', 'X');
+        static const int offset = 70;
+        static const int len = 258;
     };
 
-    /// Look up the data item location associated with identifier \a magic.
-    static const ItemInfo* find(const char* magic);
-    /// Read the data item \a magic from EEPROM into buffer \a data of size \a len.
-    static int read(const char* magic, byte* data, int len);
-    /// Write \a len bytes of data in \a data into the EEPROM item \a magic
-    static bool write(const char* magic, const byte* data, int len);
+    /// List of item tags
+    template <typename... Tags>
+    struct ItemList;
+
+    /// All known items, in order of their offset
+    typedef ItemList<BNO055Calibration, EngineCalibration, BlackBoxRecording> Items;
+
+    /**
+     * Read an item
+     *
+     * Read the data of item \a Item from EEPROM, starting at position \a pos
+     * within the item, into buffer \a data of size \a len. Returns the length
+     * of the item, or -1 if it is not stored.
+     */
+    template <typename Item>
+    static int read(void* data, int len, int pos=0);
+    /**
+     * Write \a len bytes of data in \a data into the EEPROM item \a Item,
+     * starting at position \a pos within the item.
+     */
+    template <typename Item>
+    static bool write(const void* data, int len, int pos=0);
 
 private:
-    /// Number if known data items
-    static const int _layout_size = 1;
-    /// Lookup table for item locations
-    static const ItemInfo _layout[_layout_size];
+    /// Compile time type comparison
+    template <typename A, typename B>
+    struct _Same { static const bool value = false; };
+    template <typename A>
+    struct _Same<A, A> { static const bool value = true; };
+
+    /// Read the item of length \a item_len with identifier \a magic at \a offset
+    static int _read(int offset, uint32_t magic, int item_len, void* data,
+        int len, int pos);
+    /// Write the item of length \a item_len with identifier \a magic at \a offset
+    static bool _write(int offset, uint32_t magic, int item_len,
+        const void* data, int len, int pos);
+};
+
+template <>
+struct EEPromLayout::ItemList<>
+{
+    template <typename Item>
+    static constexpr bool contains() { return false; }
+    static constexpr bool ordered(int) { return true; }
+    static constexpr int end(int min_end) { return min_end; }
+};
+
+template <typename Tag, typename... Tags>
+struct EEPromLayout::ItemList<Tag, Tags...>
+{
+    /// Return \c true if \a Item is in the list
+    template <typename Item>
+    static constexpr bool contains()
+    {
+        return _Same<Item, Tag>::value
+            || ItemList<Tags...>::template contains<Item>();
+    }
+    /// Return \c true if the items start at or after \a start, and do not overlap
+    static constexpr bool ordered(int start)
+    {
+        return Tag::offset >= start
+            && ItemList<Tags...>::ordered(Tag::offset + magic_len + Tag::len);
+    }
+    /// Return the end of the last item
+    static constexpr int end(int=0)
+    {
+        return ItemList<Tags...>::end(Tag::offset + magic_len + Tag::len);
+    }
 };
 
-#endif // EEPROMLAYOUT_H
\ No newline at end of file
+template <typename Item>
+int EEPromLayout::read(void* data, int len, int pos)
+{
+    static_assert(Items::contains<Item>(), "unknown EEPROM item");
+    return _read(Item::offset, Item::magic, Item::len, data, len, pos);
+}
+
+template <typename Item>
+bool EEPromLayout::write(const void* data, int len, int pos)
+{
+    static_assert(Items::contains<Item>(), "unknown EEPROM item");
+    return _write(Item::offset, Item::magic, Item::len, data, len, pos);
+}
+
+static_assert(EEPromLayout::Items::ordered(0),
+    "EEPROM items overlap, or are not listed in order");
+static_assert(EEPromLayout::Items::end() <= EEPromLayout::region_end,
+    "EEPROM items do not fit in the region for fixed items");
+static_assert(EEPromLayout::region_end <= E2END + 1,
+    "EEPROM region for fixed items exceeds the EEPROM size");
+
+#endif // EEPROMLAYOUT_H
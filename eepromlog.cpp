@@ -0,0 +1,358 @@
+#include <util/crc16.h>
+#include "eepromlog.h"
+#include "hal.h"
+
+namespace
+{
+
+uint16_t crcBytes(uint16_t crc, const uint8_t* data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; ++i)
+        crc = _crc16_update(crc, data[i]);
+    return crc;
+}
+
+} // namespace
+
+void EEPromLog::begin()
+{
+    // The newest page is the head of the log
+    bool found = false;
+    for (uint8_t p = 0; p < page_count; ++p)
+    {
+        uint16_t seq;
+        if (_readHeader(p, seq) && (!found || int16_t(seq - _seq) > 0))
+        {
+            _head = p;
+            _seq = seq;
+            found = true;
+        }
+    }
+
+    for (uint8_t k = 0; k < max_keys; ++k)
+        _index[k] = 0;
+
+    if (!found)
+    {
+        // Empty log. Make the first write start on page 0.
+        _head = _tail = page_count - 1;
+        _seq = 0;
+        _append = _pageStart(_head) + page_size;
+        return;
+    }
+
+    // Replay the pages from the oldest to the newest, so that newer records
+    // replace older ones in the index
+    _append = _pageStart(_head) + page_size;
+    for (uint8_t i = 1; i <= page_count; ++i)
+    {
+        uint8_t p = (_head + i) % page_count;
+        uint16_t seq;
+        // Skip invalid pages, and pages left over from an earlier round
+        if (!_readHeader(p, seq) || uint16_t(_seq - seq) >= page_count)
+            continue;
+        uint16_t end = _scanPage(p, seq);
+        if (p == _head)
+            _append = end;
+    }
+
+    // The tail is the oldest page still holding live records
+    _tail = _head;
+    for (uint8_t i = 1; i < page_count; ++i)
+    {
+        uint8_t p = (_head + i) % page_count;
+        if (_live(p))
+        {
+            _tail = p;
+            break;
+        }
+    }
+}
+
+int EEPromLog::read(uint8_t key, void* data, uint8_t len) const
+{
+    if (key >= max_keys)
+        return -1;
+
+    noInterrupts();
+    HAL_SYNC();
+    uint16_t addr = _index[key];
+    interrupts();
+    if (!addr)
+        return -1;
+
+    uint8_t rlen = _readByte(addr+1);
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    for (uint8_t i = 0; i < min(len, rlen); ++i)
+        bytes[i] = _readByte(addr + 2 + i);
+
+    return rlen;
+}
+
+bool EEPromLog::writeAt(uint16_t addr, const void* data, uint8_t len)
+{
+    if (addr + len > region_start)
+        return false;
+
+    noInterrupts();
+    HAL_SYNC();
+    bool room = _segment_count < max_segments && _fifo_count + len <= fifo_size;
+    interrupts();
+    if (!room)
+        return false;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (uint8_t i = 0; i < len; ++i)
+        _push(bytes[i]);
+    _pushSegment(addr, len, false, no_key);
+
+    _kick();
+    return true;
+}
+
+bool EEPromLog::committed(uint8_t key) const
+{
+    bool res = true;
+    noInterrupts();
+    HAL_SYNC();
+    for (uint8_t i = 0; i < _segment_count; ++i)
+    {
+        if (_segments[(_segment_start + i) % max_segments].key == key)
+            res = false;
+    }
+    interrupts();
+    return res;
+}
+
+bool EEPromLog::pending() const
+{
+    noInterrupts();
+    HAL_SYNC();
+    bool res = _segment_count != 0;
+    interrupts();
+    return res;
+}
+
+void EEPromLog::poll()
+{
+    if (_freePages() >= 2 || _tail == _head)
+        return;
+
+    // Move the live records out of the oldest page. Records with a newer
+    // write queued are left alone, the queued write replaces them.
+    uint16_t start = _pageStart(_tail);
+    uint8_t data[max_len];
+    for (uint8_t k = 0; k < max_keys; ++k)
+    {
+        noInterrupts();
+        HAL_SYNC();
+        uint16_t addr = _index[k];
+        interrupts();
+        if (addr < start || addr >= start + page_size || !committed(k))
+            continue;
+
+        int len = read(k, data, sizeof(data));
+        if (!_write(k, data, len, true))
+            // Queue full, try again in the next poll
+            return;
+    }
+
+    // Once the copies are written, the index no longer refers to the page
+    if (!_live(_tail))
+        _tail = _next(_tail);
+}
+
+void EEPromLog::eepromReady()
+{
+    while (_segment_count)
+    {
+        Segment& s = _segments[_segment_start];
+        if (!s.len)
+        {
+            // Segment written completely
+            if (s.key != no_key)
+                _index[s.key] = s.record;
+            _segment_start = (_segment_start + 1) % max_segments;
+            --_segment_count;
+            continue;
+        }
+
+        uint8_t value = 0xff;
+        if (!s.fill)
+        {
+            value = _fifo[_fifo_start];
+            _fifo_start = (_fifo_start + 1) % fifo_size;
+            --_fifo_count;
+        }
+        uint16_t addr = s.addr++;
+        --s.len;
+
+        // Only write bytes that change, saving both time and wear
+        EEAR = addr;
+        EECR |= (1 << EERE);
+        if (EEDR != value)
+        {
+            EEDR = value;
+            EECR |= (1 << EEMPE);
+            EECR |= (1 << EEPE);
+            return;
+        }
+    }
+
+    // Nothing left to write
+    EECR &= ~(1 << EERIE);
+}
+
+uint8_t EEPromLog::_readByte(uint16_t addr)
+{
+    // The EEPROM cannot be read while a write is in progress, and the
+    // interrupt handler may start a new write at any time.
+    for (;;)
+    {
+        noInterrupts();
+        if (!(EECR & (1 << EEPE)))
+            break;
+        interrupts();
+    }
+    EEAR = addr;
+    EECR |= (1 << EERE);
+    uint8_t res = EEDR;
+    interrupts();
+    return res;
+}
+
+uint16_t EEPromLog::_headerCrc(uint16_t seq)
+{
+    uint16_t crc = 0xffff;
+    crc = _crc16_update(crc, seq & 0xff);
+    return _crc16_update(crc, seq >> 8);
+}
+
+bool EEPromLog::_readHeader(uint8_t page, uint16_t& seq)
+{
+    uint16_t addr = _pageStart(page);
+    seq = _readByte(addr) | (_readByte(addr+1) << 8);
+    uint16_t crc = _readByte(addr+2) | (_readByte(addr+3) << 8);
+    return crc == _headerCrc(seq);
+}
+
+uint16_t EEPromLog::_scanPage(uint8_t page, uint16_t seq)
+{
+    uint16_t pos = _pageStart(page) + header_size;
+    uint16_t end = _pageStart(page) + page_size;
+    while (pos + record_overhead <= end)
+    {
+        uint8_t key = _readByte(pos);
+        uint8_t len = _readByte(pos+1);
+        // Stop at the erased end of the page, or at a corrupt record
+        if (key >= max_keys || len > max_len || pos + record_overhead + len > end)
+            break;
+
+        uint16_t crc = _headerCrc(seq);
+        for (uint8_t i = 0; i < len + 2; ++i)
+            crc = _crc16_update(crc, _readByte(pos + i));
+        uint16_t stored = _readByte(pos + 2 + len) | (_readByte(pos + 3 + len) << 8);
+        if (crc != stored)
+            break;
+
+        _index[key] = pos;
+        pos += record_overhead + len;
+    }
+    return pos;
+}
+
+bool EEPromLog::_live(uint8_t page) const
+{
+    uint16_t start = _pageStart(page);
+    for (uint8_t k = 0; k < max_keys; ++k)
+    {
+        noInterrupts();
+        HAL_SYNC();
+        uint16_t addr = _index[k];
+        interrupts();
+        if (addr >= start && addr < start + page_size)
+            return true;
+    }
+    return false;
+}
+
+bool EEPromLog::_write(uint8_t key, const void* data, uint8_t len,
+    bool relocating)
+{
+    if (key >= max_keys || len > max_len)
+        return false;
+
+    uint8_t size = record_overhead + len;
+    bool new_page = _append + size > _pageStart(_head) + page_size;
+    if (new_page && _freePages() < (relocating ? 1 : 2))
+        return false;
+
+    noInterrupts();
+    HAL_SYNC();
+    bool room = _segment_count + (new_page ? 3 : 1) <= max_segments
+        && _fifo_count + size + (new_page ? header_size : 0) <= fifo_size;
+    interrupts();
+    if (!room)
+        return false;
+
+    if (new_page)
+        _startPage();
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint16_t crc = _headerCrc(_seq);
+    crc = _crc16_update(crc, key);
+    crc = _crc16_update(crc, len);
+    crc = crcBytes(crc, bytes, len);
+
+    _push(key);
+    _push(len);
+    for (uint8_t i = 0; i < len; ++i)
+        _push(bytes[i]);
+    _push(crc & 0xff);
+    _push(crc >> 8);
+    _pushSegment(_append, size, false, key);
+    _append += size;
+
+    _kick();
+    return true;
+}
+
+void EEPromLog::_startPage()
+{
+    _head = _next(_head);
+    ++_seq;
+    uint16_t start = _pageStart(_head);
+
+    // Erase the page, header first, so that a partly erased page is invalid
+    _pushSegment(start, page_size, true, no_key);
+
+    uint16_t crc = _headerCrc(_seq);
+    _push(_seq & 0xff);
+    _push(_seq >> 8);
+    _push(crc & 0xff);
+    _push(crc >> 8);
+    _pushSegment(start, header_size, false, no_key);
+
+    _append = start + header_size;
+}
+
+void EEPromLog::_push(uint8_t b)
+{
+    noInterrupts();
+    _fifo[(_fifo_start + _fifo_count) % fifo_size] = b;
+    ++_fifo_count;
+    interrupts();
+}
+
+void EEPromLog::_pushSegment(uint16_t addr, uint8_t len, bool fill, uint8_t key)
+{
+    noInterrupts();
+    Segment& s = _segments[(_segment_start + _segment_count) % max_segments];
+    s.addr = addr;
+    s.len = len;
+    s.fill = fill;
+    s.key = key;
+    s.record = addr;
+    ++_segment_count;
+    interrupts();
+}
@@ -0,0 +1,209 @@
+#ifndef EEPROMLOG_H
+#define EEPROMLOG_H
+
+#include <Arduino.h>
+#include "eepromlayout.h"
+
+/**
+ * Class for a log-structured store in EEPROM
+ *
+ * Class EEPromLog stores small, frequently changing data items (trims,
+ * counters, tuned parameters) in the part of the EEPROM above the fixed items
+ * of EEPromLayout. Items are identified by a small numeric key. Instead of
+ * rewriting an item in place, every write appends a new record to a log, so
+ * that the writes are spread evenly over the whole region.
+ *
+ * The region is divided into pages, which are used round robin. Each page
+ * starts with a header holding a sequence number, which orders the pages.
+ * A record consists of the key, the data length, the data, and a CRC16 over
+ * the page sequence number, key, length, and data. A record torn by a power
+ * loss fails its CRC check, and the previous record for the key is used
+ * instead. When only one unused page is left, the live records in the oldest
+ * page are copied to the head of the log by poll(), so that the oldest page
+ * can be reused.
+ *
+ * On start up, begin() scans the log once and builds an index in SRAM of the
+ * newest valid record of every key, so that reads don't need to search.
+ *
+ * Writes do not block: the bytes to write are queued, and written one by one
+ * from the EEPROM ready interrupt. The index is updated when a record has
+ * been written completely. Larger data outside the log, such as the BlackBox
+ * recording, can be written through the same queue with writeAt(). The
+ * interrupt handler should be defined in the sketch, as an event for HAL
+ * replay (see hal.h):
+ * \code
+ * ISR(EE_READY_vect)
+ * {
+ *     HAL_ISR(EE_READY);
+ *     HAL_ISR_EVENT();
+ *     eeprom_log.eepromReady();
+ * }
+ * \endcode
+ * EEPromLayout waits for the background writes to finish before it accesses
+ * the EEPROM itself.
+ */
+class EEPromLog
+{
+public:
+    /// Number of different keys
+    static const uint8_t max_keys = 16;
+    /// Start of the log region in EEPROM
+    static const uint16_t region_start = EEPromLayout::region_end;
+    /// End of the log region in EEPROM
+    static const uint16_t region_end = 1024;
+    /// Size of a page in bytes
+    static const uint8_t page_size = 64;
+    /// Number of pages in the log
+    static const uint8_t page_count = (region_end - region_start) / page_size;
+    /// Size of a page header: sequence number and CRC
+    static const uint8_t header_size = 4;
+    /// Size of the record fields besides the data: key, length, and CRC
+    static const uint8_t record_overhead = 4;
+    /// Maximum length of the data of an item
+    static const uint8_t max_len = page_size - header_size - record_overhead;
+
+    /// Constructor
+    EEPromLog(): _head(0), _tail(0), _seq(0), _append(0), _fifo_start(0),
+        _fifo_count(0), _segment_start(0), _segment_count(0), _index{0} {}
+
+    /// Scan the log and build the index. Call this once at start up.
+    void begin();
+
+    /**
+     * Read an item
+     *
+     * Read the newest committed record for key \a key into buffer \a data
+     * of size \a len. Returns the length of the stored data, or -1 if there
+     * is no record for \a key.
+     */
+    int read(uint8_t key, void* data, uint8_t len) const;
+    /**
+     * Write an item
+     *
+     * Queue a new record for key \a key with the \a len bytes of data in
+     * \a data. The record is written in the background. Returns \c false if
+     * the arguments are invalid, or if the write queue or the log is full, in
+     * which case the write should be retried later.
+     */
+    bool write(uint8_t key, const void* data, uint8_t len)
+    {
+        return _write(key, data, len, false);
+    }
+    /**
+     * Write raw bytes
+     *
+     * Queue writing the \a len bytes in \a data at address \a addr, below the
+     * log region, e.g. into a fixed item of EEPromLayout. The bytes are
+     * written in the background, together with the log records, so that
+     * the main program never waits for the EEPROM. Returns \c false if the
+     * range is not below the log region, or if the write queue is full, in
+     * which case the write should be retried later.
+     */
+    bool writeAt(uint16_t addr, const void* data, uint8_t len);
+    /// Return \c true if no write for key \a key is waiting to be written
+    bool committed(uint8_t key) const;
+    /// Return \c true if writes are waiting to be written
+    bool pending() const;
+
+    /**
+     * Maintain the log
+     *
+     * Copy the live records out of the oldest page when the log is running
+     * out of unused pages. This function should be called regularly from the
+     * main loop.
+     */
+    void poll();
+
+    /**
+     * Handle EEPROM ready interrupt
+     *
+     * Start writing the next queued byte. This function should be called from
+     * the EEPROM ready interrupt handler.
+     */
+    void eepromReady();
+
+private:
+    /// Size of the queue of bytes to write
+    static const uint8_t fifo_size = page_size + header_size;
+    /// Maximum number of queued write segments
+    static const uint8_t max_segments = 4;
+    /// Key value for segments that do not hold a record
+    static const uint8_t no_key = 0xff;
+
+    /// A contiguous range of EEPROM to write
+    struct Segment
+    {
+        /// Next address to write
+        uint16_t addr;
+        /// Number of bytes left to write
+        uint8_t len;
+        /// Whether the range is erased (filled with 0xff) instead of written from the queue
+        bool fill;
+        /// Key of the record written, or no_key
+        uint8_t key;
+        /// Address of the record, for the index
+        uint16_t record;
+    };
+
+    /// Page currently appended to
+    uint8_t _head;
+    /// Oldest page that may hold live records
+    uint8_t _tail;
+    /// Sequence number of the head page
+    uint16_t _seq;
+    /// Address at which the next record is appended
+    uint16_t _append;
+
+    /// Queue of bytes to write
+    uint8_t _fifo[fifo_size];
+    /// Position of the first byte in the queue
+    volatile uint8_t _fifo_start;
+    /// Number of bytes in the queue
+    volatile uint8_t _fifo_count;
+    /// Queue of segments to write
+    Segment _segments[max_segments];
+    /// Position of the first segment in the queue
+    volatile uint8_t _segment_start;
+    /// Number of segments in the queue
+    volatile uint8_t _segment_count;
+
+    /// Address of the newest committed record of each key, or 0 if there is none
+    volatile uint16_t _index[max_keys];
+
+    /// Return the start address of page \a page
+    static uint16_t _pageStart(uint8_t page) { return region_start + page * page_size; }
+    /// Return the page following \a page
+    static uint8_t _next(uint8_t page) { return page+1 < page_count ? page+1 : 0; }
+    /// Return the number of pages not in use
+    uint8_t _freePages() const
+    {
+        return (_tail + page_count - _head - 1) % page_count;
+    }
+
+    /// Read the byte at \a addr, waiting for a write in progress to finish
+    static uint8_t _readByte(uint16_t addr);
+    /// Return the CRC over the header fields of a page with sequence number \a seq
+    static uint16_t _headerCrc(uint16_t seq);
+    /// Read the header of page \a page. Returns \c false if it is invalid.
+    static bool _readHeader(uint8_t page, uint16_t& seq);
+    /**
+     * Index the valid records in page \a page, with sequence number \a seq.
+     * Returns the address after the last valid record.
+     */
+    uint16_t _scanPage(uint8_t page, uint16_t seq);
+    /// Return \c true if the index holds a record in page \a page
+    bool _live(uint8_t page) const;
+
+    /// Queue a record, using the last unused page only if \a relocating
+    bool _write(uint8_t key, const void* data, uint8_t len, bool relocating);
+    /// Queue erasing the next page and writing its header
+    void _startPage();
+    /// Queue byte \a b
+    void _push(uint8_t b);
+    /// Queue a segment
+    void _pushSegment(uint16_t addr, uint8_t len, bool fill, uint8_t key);
+    /// Start the EEPROM ready interrupt
+    static void _kick() { EECR |= (1 << EERIE); }
+};
+
+#endif // EEPROMLOG_H
@@ -1,20 +1,58 @@
+#include "eepromlayout.h"
 #include "engine.h"
+#include "hal.h"
 
 namespace
 {
 
-inline MotorDirection reverseDirection(MotorDirection dir)
+inline MotorDirection signedDirection(int speed)
 {
-    switch (dir)
-    {
-        case FORWARD:  return BACKWARD;
-        case BACKWARD: return FORWARD;
-        default:       return dir;
-    }
+    return speed < 0 ? BACKWARD : FORWARD;
 }
 
 } // namespace
 
+void Engine::halt()
+{
+    _target_left = _target_right = 0;
+    _release();
+}
+
+void Engine::brake()
+{
+    _speed_left = _speed_right = 0;
+    _target_left = _target_right = 0;
+    _braking = true;
+    _release_at = 0;
+    _motor_left->queueRun(BREAK);
+    _motor_right->queueRun(BREAK);
+    _shield->flush();
+}
+
+void Engine::stop(uint16_t brake_ms)
+{
+    brake();
+    // Zero is reserved for braking indefinitely
+    _release_at = (millis() + brake_ms) | 1;
+}
+
+bool Engine::loadCalibration()
+{
+    Calibration cal;
+    if (EEPromLayout::read<EEPromLayout::EngineCalibration>(&cal, sizeof(cal))
+            != int(sizeof(cal)))
+        return false;
+
+    setCalibration(cal);
+    return true;
+}
+
+bool Engine::saveCalibration() const
+{
+    return EEPromLayout::write<EEPromLayout::EngineCalibration>(&_calibration,
+        sizeof(_calibration));
+}
+
 void Engine::moveStraight(int speed)
 {
     if (speed == 0)
@@ -27,43 +65,120 @@ void Engine::moveStraight(int speed)
 
 void Engine::turn(int speed, int turn_speed)
 {
-    if (turn_speed < 0)
+    int left, right;
+    _turnSpeeds(speed, turn_speed, left, right);
+    _drive(left, right);
+}
+
+void Engine::setTargetTurn(int speed, int turn_speed)
+{
+    int left, right;
+    _turnSpeeds(speed, turn_speed, left, right);
+    setTargetSpeeds(left, right);
+}
+
+void Engine::setVelocity(int linear, int angular)
+{
+    angular = constrain(angular, -max_speed, max_speed);
+    int max_linear = max_speed - abs(angular);
+    linear = constrain(linear, -max_linear, max_linear);
+
+    _target_left = linear + angular;
+    _target_right = linear - angular;
+}
+
+void Engine::update()
+{
+    if (atTarget())
     {
-        if (speed < 0)
-            _turnLeft(-speed, -turn_speed, BACKWARD);
-        else
-            _turnLeft(speed, -turn_speed, FORWARD);
+        if (_braking && _release_at && int32_t(millis() - _release_at) >= 0)
+            halt();
+        return;
     }
+
+    int left = _ramp(_speed_left, _target_left);
+    int right = _ramp(_speed_right, _target_right);
+    if (left == 0 && right == 0)
+        // Keep the targets, so that reversing both sides goes on from here
+        _release();
     else
-    {
-        if (speed < 0)
-            _turnRight(-speed, turn_speed, BACKWARD);
-        else
-            _turnRight(speed, turn_speed, FORWARD);
-    }
+        _apply(left, right);
 }
 
-void Engine::_turnLeft(uint8_t speed, uint8_t turn_speed, MotorDirection dir)
+void Engine::_release()
 {
-    if (turn_speed <= 0x80)
-        _move(dir, speed * (0x80-turn_speed) / 0x80, dir, speed);
-    else
-        _move(reverseDirection(dir), speed * (turn_speed-0x80) / 0x7f, dir, speed);
+    _speed_left = _speed_right = 0;
+    _braking = false;
+    _motor_left->queueRun(RELEASE);
+    _motor_right->queueRun(RELEASE);
+    _shield->flush();
+}
+
+void Engine::_apply(int left, int right)
+{
+    _speed_left = left;
+    _speed_right = right;
+    _braking = false;
+    _shield->setMotors(_motor_left, signedDirection(left), _calibrate(0, abs(left)),
+        _motor_right, signedDirection(right), _calibrate(1, abs(right)));
 }
 
-void Engine::_turnRight(uint8_t speed, uint8_t turn_speed, MotorDirection dir)
+uint16_t Engine::_calibrate(uint8_t motor, uint16_t speed) const
 {
-    if (turn_speed <= 0x80)
-        _move(dir, speed, dir, speed * (0x80-turn_speed) / 0x80);
+    if (!_calibrated || speed == 0)
+        return speed;
+
+    const uint16_t *gain = _calibration.gain[motor];
+    uint8_t idx = speed >> calibration_shift;
+    uint16_t frac = speed & ((1 << calibration_shift) - 1);
+    int32_t g = gain[idx];
+    if (idx+1 < calibration_points)
+        g += ((int32_t(gain[idx+1]) - g) * frac) >> calibration_shift;
+
+    uint16_t deadband = _calibration.deadband[motor];
+    uint32_t scaled = (uint32_t(speed) * g) >> 12;
+    return deadband + ((scaled * (max_speed - deadband)) >> 12);
+}
+
+void Engine::_turnSpeeds(int speed, int turn_speed, int& left, int& right)
+{
+    int outer = abs(speed), turn_abs = abs(turn_speed);
+    int inner = turn_abs <= 0x80
+        ? outer * (0x80-turn_abs) / 0x80
+        : -(outer * (turn_abs-0x80) / 0x7f);
+    if (speed < 0)
+    {
+        outer = -outer;
+        inner = -inner;
+    }
+
+    if (turn_speed < 0)
+    {
+        left = inner;
+        right = outer;
+    }
     else
-        _move(dir, speed, reverseDirection(dir), speed * (turn_speed-0x80) / 0x7f);
+    {
+        left = outer;
+        right = inner;
+    }
 }
 
-void Engine::_setDirections(MotorDirection left_dir, MotorDirection right_dir)
+int Engine::_ramp(int speed, int target) const
 {
-    if ((_directions >> 3) != left_dir)
-        _motor_left->run(left_dir);
-    if ((_directions & 0x07) != right_dir)
-        _motor_right->run(right_dir);
-    _directions = (left_dir << 3) | right_dir;
-}
\ No newline at end of file
+    if (speed > 0 || (speed == 0 && target > 0))
+    {
+        // Moving forward
+        if (target >= speed)
+            return min(speed + _accel, target);
+        // Slow down, but stop at zero before changing direction
+        return max(speed - _decel, max(target, 0));
+    }
+    else
+    {
+        // Moving backward
+        if (target <= speed)
+            return max(speed - _accel, target);
+        return min(speed + _decel, min(target, 0));
+    }
+}
@@ -9,12 +9,53 @@
  *
  * Class for driving a robot controlled by two motors, on on each side (be it a
  * wheel, or a track), using the Adafruit motor shield to control the motors.
- * Currently, no calibration options are provided, so it is assumed that when
- * the motors run at the same speed, the robot will go in a straight line.
+ * Without calibration, it is assumed that when the motors run at the same
+ * speed, the robot will go in a straight line. Since real motors are never
+ * quite matched, a calibration table can be loaded from EEPROM, which holds a
+ * deadband and a gain curve for each motor. These are applied to every speed
+ * command, see Calibration.
+ *
+ * The robot can either be driven directly, in which case the motor speeds are
+ * changed immediately, or by setting target speeds for both sides. In the
+ * latter case, the speeds are moved toward the targets in update(), which
+ * should be called at a fixed rate, limiting the speed change per update to
+ * the acceleration and deceleration set with setAcceleration().
+ *
+ * Internally, speeds are kept with the full 12 bit resolution of the PWM chip
+ * on the motor shield, i.e. between -4095 and 4095. The functions taking
+ * speeds between 0 and 255 scale them to this range.
  */
 class Engine
 {
 public:
+    /// Maximum speed of a motor with 12 bit resolution
+    static const int16_t max_speed = 4095;
+    /// Number of points in the gain curve of a motor
+    static const uint8_t calibration_points = 9;
+    /// Bit shift between a speed and the calibration point below it
+    static const uint8_t calibration_shift = 9;
+    /// Gain factor corresponding to unity gain
+    static const uint16_t unit_gain = 4096;
+
+    /**
+     * Motor calibration data
+     *
+     * Calibration table for the two motors, index 0 for the left motor and
+     * 1 for the right motor. A requested speed \f$s\f$ is first multiplied by
+     * the gain, linearly interpolated between the gains at speeds
+     * \f$i\cdot 512\f$, and the result is then mapped onto the range between
+     * the deadband and the maximum speed:
+     * \f[ s' = d + \frac{g(s)}{4096}\, s \, \frac{4095 - d}{4096} \f]
+     * A speed of zero is always mapped to zero.
+     */
+    struct Calibration
+    {
+        /// Largest PWM value at which each motor does not yet turn
+        uint16_t deadband[2];
+        /// Gain at each calibration point, with 4096 meaning unity gain
+        uint16_t gain[2][calibration_points];
+    };
+
     /**
      * Constructor
      *
@@ -22,15 +63,49 @@ public:
      * of the motor shield.
      */
     Engine(Adafruit_MotorShield *shield):
+        _shield(shield),
         _motor_left(shield->getMotor(DC_MOTOR_1)),
         _motor_right(shield->getMotor(DC_MOTOR_2)),
-        _directions((RELEASE << 3) | RELEASE) {}
+        _speed_left(0), _speed_right(0), _target_left(0), _target_right(0),
+        _accel(max_speed), _decel(max_speed), _calibrated(false),
+        _braking(false), _release_at(0) {}
 
     /// Halt the robot, releasing both motors
-    void halt()
+    void halt();
+    /**
+     * Brake
+     *
+     * Stop the robot as quickly as possible by shorting both motors, and keep
+     * them braked until the robot is driven again or halted.
+     */
+    void brake();
+    /**
+     * Brake, then release
+     *
+     * Stop the robot by braking both motors for \a brake_ms milliseconds,
+     * after which the motors are released by update(). Braking stops the
+     * robot much shorter than letting it coast to a halt.
+     * \param brake_ms Time in milliseconds to keep the motors braked.
+     */
+    void stop(uint16_t brake_ms);
+    /// Return \c true if the motors are braked
+    bool braking() const { return _braking; }
+
+    /// Load the motor calibration table from EEPROM. Returns \c false if none is stored.
+    bool loadCalibration();
+    /// Store the current motor calibration table in EEPROM
+    bool saveCalibration() const;
+    /// Use calibration table \a cal for all subsequent speed commands
+    void setCalibration(const Calibration& cal)
     {
-        _setDirections(RELEASE, RELEASE);
+        _calibration = cal;
+        _calibrated = true;
     }
+    /// Stop applying a calibration table
+    void clearCalibration() { _calibrated = false; }
+    /// Return the current calibration table
+    const Calibration& calibration() const { return _calibration; }
+
     /**
      * Move forward
      *
@@ -40,7 +115,7 @@ public:
      */
     void moveForward(uint8_t speed)
     {
-        _move(FORWARD, speed, FORWARD, speed);
+        _drive(speed, speed);
     }
     /**
      * Move backward
@@ -51,7 +126,7 @@ public:
      */
     void moveBackward(uint8_t speed)
     {
-        _move(BACKWARD, speed, BACKWARD, speed);
+        _drive(-speed, -speed);
     }
     /**
      * Move in a straight line
@@ -76,7 +151,7 @@ public:
      */
     void turnLeftForward(uint8_t speed, uint8_t turn_speed)
     {
-        _turnLeft(speed, turn_speed, FORWARD);
+        turn(speed, -turn_speed);
     }
     /**
      * Turn right going forward
@@ -90,7 +165,7 @@ public:
      */
     void turnRightForward(uint8_t speed, uint8_t turn_speed)
     {
-        _turnRight(speed, turn_speed, FORWARD);
+        turn(speed, turn_speed);
     }
     /**
      * Turn left going backward
@@ -104,7 +179,7 @@ public:
      */
     void turnLeftBackward(uint8_t speed, uint8_t turn_speed)
     {
-        _turnLeft(speed, turn_speed, BACKWARD);
+        turn(-speed, -turn_speed);
     }
     /**
      * Turn right going backward
@@ -118,7 +193,7 @@ public:
      */
     void turnRightBackward(uint8_t speed, uint8_t turn_speed)
     {
-        _turnRight(speed, turn_speed, BACKWARD);
+        turn(-speed, turn_speed);
     }
     /**
      * Turn the robot
@@ -132,44 +207,130 @@ public:
      */
     void turn(int speed, int turn_speed);
 
+    /**
+     * Set the acceleration limits
+     *
+     * Set the maximum change in speed per call to update(), in 12 bit speed
+     * units. The speed of a side increases by at most \a accel, and decreases
+     * by at most \a decel per update. A value of \c max_speed means the
+     * target speed is reached in a single update.
+     * \param accel Maximum speed increase per update.
+     * \param decel Maximum speed decrease per update.
+     */
+    void setAcceleration(uint16_t accel, uint16_t decel)
+    {
+        _accel = accel;
+        _decel = decel;
+    }
+    /**
+     * Set the target speeds
+     *
+     * Set the speeds toward which the motors will be moved in update(). A
+     * negative speed makes a side drive backward, the magnitude should be at
+     * most 255.
+     * \param left  The target speed of the left side.
+     * \param right The target speed of the right side.
+     */
+    void setTargetSpeeds(int left, int right)
+    {
+        _target_left = _expand(left);
+        _target_right = _expand(right);
+    }
+    /// Set the target speed for driving in a straight line at velocity \a speed
+    void setTargetSpeed(int speed) { setTargetSpeeds(speed, speed); }
+    /**
+     * Set a target turn
+     *
+     * Set the target speeds for turning with velocity \a speed and turning
+     * speed \a turn_speed. The arguments are the same as for turn().
+     */
+    void setTargetTurn(int speed, int turn_speed);
+    /**
+     * Set the target velocity
+     *
+     * Set the target speeds of both sides from a linear and an angular
+     * velocity, with the full 12 bit resolution. The left side is driven at
+     * \a linear + \a angular, the right side at \a linear - \a angular.
+     * When this would exceed the maximum speed, the linear velocity is reduced
+     * so that the robot still turns at the requested rate.
+     * \param linear  Forward velocity, between -4095 and 4095.
+     * \param angular Turning velocity, between -4095 (turning left in place)
+     *                and 4095 (turning right in place).
+     */
+    void setVelocity(int linear, int angular);
+    /// Return the current 12 bit speed of the left side, negative when going backward
+    int speedLeft() const { return _speed_left; }
+    /// Return the current 12 bit speed of the right side, negative when going backward
+    int speedRight() const { return _speed_right; }
+    /// Return the 12 bit target speed of the left side
+    int targetLeft() const { return _target_left; }
+    /// Return the 12 bit target speed of the right side
+    int targetRight() const { return _target_right; }
+    /// Return \c true if both sides are running at their target speeds
+    bool atTarget() const
+    {
+        return _speed_left == _target_left && _speed_right == _target_right;
+    }
+    /**
+     * Update the motor speeds
+     *
+     * Move the speeds of the motors toward their target speeds, within the
+     * acceleration limits. This function should be called at a fixed rate.
+     * When both sides come to a standstill, the motors are released. When the
+     * motors are braked by stop(), they are released once the braking time
+     * has passed.
+     */
+    void update();
+
 private:
+    /// The motor shield the motors are connected to
+    Adafruit_MotorShield *_shield;
     /// Motor driving the left track
     Adafruit_DCMotor *_motor_left;
     /// Motor driving the right track
     Adafruit_DCMotor *_motor_right;
-    /**
-     * Directions the motors are turning. Lower three bits for the direction of
-     * the left motor, bits 4-6 for the right motor.
-     */
-    uint8_t _directions;
+    /// Current speeds of the left and right side, negative when going backward
+    int16_t _speed_left, _speed_right;
+    /// Target speeds of the left and right side
+    int16_t _target_left, _target_right;
+    /// Maximum speed increase per update, signed to keep the ramp arithmetic signed on the AVR
+    int16_t _accel;
+    /// Maximum speed decrease per update
+    int16_t _decel;
+    /// Calibration table for the motors
+    Calibration _calibration;
+    /// Whether the calibration table should be applied
+    bool _calibrated;
+    /// Whether the motors are braked
+    bool _braking;
+    /// Time (millis()) at which braked motors are released, 0 to keep braking
+    uint32_t _release_at;
 
-    /// Set and store the running directions of the motors
-    void _setDirections(MotorDirection left_dir, MotorDirection right_dir);
-    /// Set the turning speeds of the motors
-    void _setSpeed(uint8_t left_speed, uint8_t right_speed)
+    /// Scale an 8 bit speed between -255 and 255 to 12 bit resolution
+    static int _expand(int speed)
     {
-        _motor_left->setSpeed(left_speed);
-        _motor_right->setSpeed(right_speed);
+        return speed < 0 ? -((-speed << 4) | (-speed >> 4))
+            : ((speed << 4) | (speed >> 4));
     }
-
     /**
-     * Set the direction and speed of both motors.
-     * \param left_dir    running direction of the left.
-     * \param left_speed  turning speed of the left motor.
-     * \param right_dir   running direction of the left.
-     * \param right_speed turning speed of the left motor.
+     * Drive at 8 bit speeds \a left and \a right immediately, and make these
+     * the targets.
      */
-    void _move(MotorDirection left_dir, uint8_t left_speed,
-        MotorDirection right_dir, uint8_t right_speed)
+    void _drive(int left, int right)
     {
-        _setDirections(left_dir, right_dir);
-        _setSpeed(left_speed, right_speed);
+        setTargetSpeeds(left, right);
+        _apply(_target_left, _target_right);
     }
-
-    /// Turn the robot left
-    void _turnLeft(uint8_t speed, uint8_t turn_speed, MotorDirection dir);
-    /// Turn the robot right
-    void _turnRight(uint8_t speed, uint8_t turn_speed, MotorDirection dir);
+    /// Release both motors, without changing the targets
+    void _release();
+    /// Set the motors to run at (signed) 12 bit speeds \a left and \a right
+    void _apply(int left, int right);
+    /// Apply the calibration for motor \a motor to 12 bit speed \a speed
+    uint16_t _calibrate(uint8_t motor, uint16_t speed) const;
+    /// Compute the wheel speeds for a turn, see turn()
+    static void _turnSpeeds(int speed, int turn_speed, int& left, int& right);
+    /// Return the next speed when moving from \a speed to \a target
+    int _ramp(int speed, int target) const;
 };
 
 #endif // ENGINE_H
\ No newline at end of file
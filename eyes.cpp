@@ -1,5 +1,6 @@
 #include "eyes.h"
 #include "settings.h"
+#include "hal.h"
 
 namespace
 {
@@ -50,7 +51,7 @@ void Eyes::infraredTick()
     if (--_current_IR_tick == 0)
     {
         infraredMeasure(_current_IR_number);
-        _current_IR_tick = IR_trigger_ticks;
+        _current_IR_tick = _IR_trigger_ticks;
         _current_IR_number = static_cast<IRSensorNumber>(_current_IR_number+1);
         if (_current_IR_number == IR_COUNT)
             _current_IR_number = IR_CENTER;
@@ -59,8 +60,21 @@ void Eyes::infraredTick()
 
 void Eyes::infraredMeasure(IRSensorNumber which)
 {
+    _IR_sample_us[which] = micros();
     int v = analogRead(IR_pins[which]);
     _IR_last_distance[which] = infraredVoltToCm(v);
+    ++_IR_frame;
+}
+
+uint32_t Eyes::sampleTime() const
+{
+    uint32_t oldest = _IR_sample_us[0];
+    for (uint8_t i = 1; i < IR_COUNT; ++i)
+    {
+        if (int32_t(_IR_sample_us[i] - oldest) < 0)
+            oldest = _IR_sample_us[i];
+    }
+    return oldest;
 }
 
 unsigned int Eyes::infraredVoltToCm(unsigned int v)
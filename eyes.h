@@ -2,6 +2,7 @@
 #define EYES_H
 
 #include "Arduino.h"
+#include "settings.h"
 
 /**
  * Class for distance sensors
@@ -25,7 +26,9 @@ public:
     Eyes():
 		_current_US_tick(1), _US_pulse_on(false),
 		_current_IR_tick(1), _current_IR_number(IR_CENTER),
-		 _US_last_distance(0), _IR_last_distance{0, 0, 0} {}
+		_IR_trigger_ticks(IR_trigger_ticks),
+		 _US_last_distance(0), _IR_last_distance{0, 0, 0},
+		_IR_frame(0), _IR_sample_us{0, 0, 0} {}
 
     /**
      * Handle timer tick
@@ -53,6 +56,8 @@ public:
      * through the different IR sensors.
      */
     void infraredTick();
+    /// Measure an infrared distance every \a ticks timer ticks, instead of \c IR_trigger_ticks
+    void setInfraredInterval(uint16_t ticks) { _IR_trigger_ticks = ticks; }
     /**
      * Measure distance using IR
      *
@@ -70,10 +75,36 @@ public:
             dr = 14 * _IR_last_distance[2] / 10;
         return min(dc, min(dl, dr));
     }
+    /// Return the last distance measured by infrared sensor \a which
+    uint16_t infraredDistance(IRSensorNumber which) const
+    {
+        return _IR_last_distance[which];
+    }
     int turnDirection() const
     {
         return _IR_last_distance[1] < _IR_last_distance[2] ? 1 : -1;
     }
+    /**
+     * Return the number of infrared measurements so far, modulo 256. When it
+     * changes, distance() has new data.
+     */
+    uint8_t frame() const { return _IR_frame; }
+    /**
+     * Return the time (micros()) at which the oldest of the infrared
+     * distances was sampled. Since distance() combines all sensors, this is
+     * the age of the data it is based on.
+     */
+    uint32_t sampleTime() const;
+
+	/**
+	 * Convert voltage to centimeters
+	 *
+	 * Convert a voltage from the infrared sensor to the corresponding distance
+	 * in centimeters.
+	 * \param v The voltage from the sensor
+	 * \return The distance corresponding to \a v
+	 */
+	static unsigned int infraredVoltToCm(unsigned int v);
 
 private:
     /// Current time tick. When it reaches zero, a new ultrasound pulse is sent
@@ -86,21 +117,16 @@ private:
 	uint16_t _current_IR_tick;
 	/// Which IR sensor to poll next
 	IRSensorNumber _current_IR_number;
+	/// Number of timer ticks between IR distance measurements
+	uint16_t _IR_trigger_ticks;
     /// Last successful distance reading from the ultrasound sensor
     volatile uint16_t _US_last_distance;
     /// Last successful distance reading from the infrared sensors (center, left, right)
     volatile uint16_t _IR_last_distance[IR_COUNT];
-
-	/**
-	 * Convert voltage to centimeters
-	 *
-	 * Convert a voltage from the infrared sensor to the corresponding distance
-	 * in centimeters.
-	 * \param v The voltage from the sensor
-	 * \return The distance corresponding to \a v
-	 */
-	static unsigned int infraredVoltToCm(unsigned int v);
-
+    /// Number of infrared measurements, modulo 256
+    volatile uint8_t _IR_frame;
+    /// Time (micros()) at which each infrared sensor was last sampled
+    uint32_t _IR_sample_us[IR_COUNT];
 };
 
 #endif // EYES_H
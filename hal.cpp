@@ -0,0 +1,351 @@
+#include "hal.h"
+
+#ifdef HAL_RECORD
+
+#include <avr/eeprom.h>
+
+// This file implements the wrappers, so it needs the real functions
+#undef millis
+#undef micros
+#undef analogRead
+#undef digitalRead
+#undef Wire
+#undef Serial
+
+HalWire hal_wire;
+HalSerial hal_serial;
+
+namespace
+{
+
+// Size of the buffer holding the stream until it is sent, a power of two
+const uint16_t buffer_size = 128;
+// Size of the buffer holding the records of interrupt handlers until the next
+// synchronization point
+const uint8_t isr_buffer_size = 24;
+// Longest record that can be repeated with a REPEAT control record
+const uint8_t max_repeatable = 6;
+
+uint8_t buffer[buffer_size];
+uint8_t buffer_start = 0, buffer_count = 0;
+volatile uint16_t lost = 0;
+
+uint8_t isr_buffer[isr_buffer_size];
+volatile uint8_t isr_count = 0;
+volatile bool in_isr = false;
+volatile bool isr_event = false;
+// Handler invocations not recorded yet
+volatile uint16_t isr_pending = 0;
+volatile Hal::Vector isr_vector = Hal::TIMER1_COMPA;
+
+// Last record, and the number of times it has been repeated since
+uint8_t last[max_repeatable];
+uint8_t last_len = 0;
+uint16_t repeats = 0;
+
+// Last times read, in the main program and in the handlers. Handler records
+// reach the stream later than main program records read after them, so each
+// context has its own base for the time increases.
+uint32_t last_ms[2];
+uint32_t last_us[2];
+
+inline uint8_t tag(Hal::RecordType type, uint8_t arg)
+{
+    return (type << 5) | arg;
+}
+
+/// Store \a value as a varint at \a dest, and return the number of bytes used
+uint8_t putVarint(uint8_t* dest, uint32_t value)
+{
+    uint8_t n = 0;
+    while (value >= 0x80)
+    {
+        dest[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    dest[n++] = value;
+    return n;
+}
+
+void put(const uint8_t* data, uint8_t len)
+{
+    if (lost || buffer_count + len > buffer_size)
+    {
+        lost += len;
+        return;
+    }
+    for (uint8_t i = 0; i < len; ++i)
+        buffer[(buffer_start + buffer_count++) % buffer_size] = data[i];
+}
+
+void putRepeats()
+{
+    if (repeats == 0)
+        return;
+
+    uint8_t rec[4];
+    uint8_t len = 1;
+    if (repeats <= 31 - Hal::REPEAT_SHORT + 1)
+    {
+        rec[0] = tag(Hal::CONTROL, Hal::REPEAT_SHORT + repeats - 1);
+    }
+    else
+    {
+        rec[0] = tag(Hal::CONTROL, Hal::REPEAT);
+        len += putVarint(rec + 1, repeats);
+    }
+    put(rec, len);
+    repeats = 0;
+}
+
+/// Put the handler invocations and the records of interrupt handlers in the stream
+void putInterrupts(bool at_sync)
+{
+    if (!isr_event)
+        return;
+
+    putRepeats();
+    last_len = 0;
+    if (at_sync)
+    {
+        uint8_t rec = tag(Hal::CONTROL, Hal::SYNC);
+        put(&rec, 1);
+    }
+    put(isr_buffer, isr_count);
+    isr_count = 0;
+    isr_event = false;
+}
+
+/// Record the pending handler invocations, from within a handler
+void recordInvocations()
+{
+    if (isr_pending == 0)
+        return;
+
+    uint8_t rec[4];
+    rec[0] = tag(Hal::INTERRUPT, isr_vector);
+    uint8_t len = 1 + putVarint(rec + 1, isr_pending);
+    if (isr_count + len <= isr_buffer_size)
+    {
+        memcpy(isr_buffer + isr_count, rec, len);
+        isr_count += len;
+    }
+    else
+    {
+        lost += len;
+    }
+    isr_pending = 0;
+    isr_event = true;
+}
+
+/**
+ * Record \a len bytes in \a rec. In a handler, the record is added to the
+ * handler records; in the main program, this is a synchronization point.
+ */
+void record(const uint8_t* rec, uint8_t len)
+{
+    uint8_t sreg = SREG;
+    cli();
+    if (in_isr)
+    {
+        recordInvocations();
+        if (isr_count + len <= isr_buffer_size)
+        {
+            memcpy(isr_buffer + isr_count, rec, len);
+            isr_count += len;
+        }
+        else
+        {
+            lost += len;
+        }
+    }
+    else
+    {
+        putInterrupts(false);
+        if (len == last_len && len <= max_repeatable && memcmp(rec, last, len) == 0)
+        {
+            ++repeats;
+        }
+        else
+        {
+            putRepeats();
+            put(rec, len);
+            last_len = len <= max_repeatable ? len : 0;
+            memcpy(last, rec, last_len);
+        }
+    }
+    SREG = sreg;
+}
+
+/// Send as much of the stream as fits in the serial buffer, without blocking
+void drain()
+{
+    // Only the main program touches the stream buffer, but the handlers may
+    // lose records
+    uint8_t sreg = SREG;
+    cli();
+    if (lost && buffer_count + 4 <= buffer_size)
+    {
+        // Tell the replayer it cannot go on from here
+        uint8_t rec[4];
+        rec[0] = tag(Hal::CONTROL, Hal::LOST);
+        uint8_t len = 1 + putVarint(rec + 1, lost);
+        lost = 0;
+        put(rec, len);
+    }
+    SREG = sreg;
+
+    int room = Serial.availableForWrite();
+    while (room-- > 0 && buffer_count)
+    {
+        Serial.write(buffer[buffer_start]);
+        buffer_start = (buffer_start + 1) % buffer_size;
+        --buffer_count;
+    }
+}
+
+} // namespace
+
+void Hal::begin()
+{
+    Serial.begin(baud_rate);
+    for (uint8_t i = 0; i < 4; ++i)
+        Serial.write(uint8_t(magic >> (8*i)));
+    for (uint16_t addr = 0; addr <= E2END; ++addr)
+        Serial.write(eeprom_read_byte(reinterpret_cast<const uint8_t*>(addr)));
+}
+
+void Hal::sync()
+{
+    putInterrupts(true);
+}
+
+uint32_t Hal::millis()
+{
+    uint32_t now = ::millis();
+    uint32_t delta = now - last_ms[in_isr];
+    last_ms[in_isr] = now;
+
+    uint8_t rec[6];
+    uint8_t len = 1;
+    if (delta < 31)
+    {
+        rec[0] = tag(TIME_MS, delta);
+    }
+    else
+    {
+        rec[0] = tag(TIME_MS, 31);
+        len += putVarint(rec + 1, delta);
+    }
+    record(rec, len);
+    drain();
+    return now;
+}
+
+uint32_t Hal::micros()
+{
+    uint32_t now = ::micros();
+    uint8_t rec[6];
+    rec[0] = tag(TIME_US, 0);
+    uint8_t len = 1 + putVarint(rec + 1, now - last_us[in_isr]);
+    last_us[in_isr] = now;
+    record(rec, len);
+    return now;
+}
+
+int Hal::analogRead(uint8_t pin)
+{
+    int value = ::analogRead(pin);
+    uint8_t rec[3];
+    rec[0] = tag(ANALOG_IN, (pin >= A0 ? pin - A0 : pin) & 0x1f);
+    uint8_t len = 1 + putVarint(rec + 1, value);
+    record(rec, len);
+    return value;
+}
+
+int Hal::digitalRead(uint8_t pin)
+{
+    int value = ::digitalRead(pin);
+    uint8_t rec[2] = { tag(DIGITAL_IN, pin & 0x1f), uint8_t(value) };
+    record(rec, 2);
+    return value;
+}
+
+void Hal::isrEvent()
+{
+    recordInvocations();
+}
+
+void Hal::isrEnter(Vector vector)
+{
+    if (vector != isr_vector && isr_pending)
+        recordInvocations();
+    isr_vector = vector;
+    // Do not let the count overflow when there are no events for a while
+    if (++isr_pending == 0xffff)
+        recordInvocations();
+    in_isr = true;
+}
+
+void Hal::isrLeave()
+{
+    in_isr = false;
+}
+
+uint8_t HalWire::requestFrom(uint8_t addr, uint8_t len, uint8_t stop)
+{
+    _len = Wire.requestFrom(addr, len, stop);
+    for (_pos = 0; _pos < _len; ++_pos)
+        _buf[_pos] = Wire.read();
+    _pos = 0;
+
+    // Tag, length byte for long reads, and data
+    uint8_t rec[2 + BUFFER_LENGTH];
+    rec[0] = tag(Hal::I2C_IN, _len < 31 ? _len : 31);
+    uint8_t n = 1;
+    if (_len >= 31)
+        rec[n++] = _len;
+    memcpy(rec + n, _buf, _len);
+    record(rec, n + _len);
+    return _len;
+}
+
+void HalSerial::begin(unsigned long)
+{
+    // The recording stream owns the serial port
+}
+
+int HalSerial::available()
+{
+    int n = Serial.available();
+    uint8_t rec[4];
+    rec[0] = tag(Hal::SERIAL_IN, Hal::SERIAL_AVAILABLE);
+    record(rec, 1 + putVarint(rec + 1, n));
+    return n;
+}
+
+int HalSerial::read()
+{
+    int c = Serial.read();
+    uint8_t rec[2] = { tag(Hal::SERIAL_IN, c < 0 ? Hal::SERIAL_READ_NONE : Hal::SERIAL_READ),
+        uint8_t(c) };
+    record(rec, c < 0 ? 1 : 2);
+    return c;
+}
+
+int HalSerial::peek()
+{
+    int c = Serial.peek();
+    uint8_t rec[2] = { tag(Hal::SERIAL_IN, c < 0 ? Hal::SERIAL_PEEK_NONE : Hal::SERIAL_PEEK),
+        uint8_t(c) };
+    record(rec, c < 0 ? 1 : 2);
+    return c;
+}
+
+size_t HalSerial::write(uint8_t)
+{
+    // Output can be reproduced from the recording
+    return 1;
+}
+
+#endif // HAL_RECORD
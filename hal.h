@@ -0,0 +1,206 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "eepromlayout.h"
+
+/**
+ * Recording and replay of hardware inputs
+ *
+ * When the robot code is built with \c HAL_RECORD defined, every input it
+ * reads from the hardware (millis(), micros(), analogRead(), digitalRead(),
+ * the bytes received over I2C, and serial input) is logged with the Hal
+ * functions below, in a compact binary stream written to the serial port at
+ * \c baud_rate. The serial output of the sketch itself is dropped, since it
+ * can be reproduced from the recording. When built on the host with
+ * \c HAL_REPLAY defined, the same functions read the inputs back from a
+ * recording (see host/replay), so that the code runs exactly as it did on
+ * the robot. Without either define, this header only defines empty macros.
+ *
+ * The wrappers are installed by macros, in the same way as \c Wire is
+ * replaced by \c TinyWireM in bno055.h, so every file reading inputs should
+ * include this header after its other includes.
+ *
+ * Interrupt handlers are the tricky part: replay has to run them at the
+ * same point relative to the main program as they ran on the robot. Every
+ * handler that can influence the main program starts with HAL_ISR(), which
+ * counts its invocations, and calls HAL_ISR_EVENT() when it changes state
+ * the main program reads. Inputs read in a handler count as events too. The
+ * main program calls HAL_SYNC() with interrupts disabled where it reads
+ * state shared with a handler; every input read by the main program is a
+ * synchronization point as well. At a synchronization point after an event,
+ * the number of handler invocations so far is recorded, followed by the
+ * inputs read in the handlers. Invocations without an event only change
+ * state private to the handler, so replay may run them late, in a batch.
+ *
+ * The stream starts with the four byte \c magic and the contents of the
+ * EEPROM. Every record then starts with a tag byte, holding the record type
+ * in the top three bits and a small argument in the low five bits, see
+ * RecordType. Numbers are stored as little endian base 128 varints.
+ */
+class Hal
+{
+public:
+    /// Baud rate of the recording stream
+    static const uint32_t baud_rate = 115200;
+    /// Start of the recording stream
+    static const uint32_t magic = eepromMagic('H', 'A', 'L', '1');
+
+    /// Record types, in the top three bits of a tag byte
+    enum RecordType: uint8_t
+    {
+        /**
+         * millis() read: argument is the increase, or 31 with a varint
+         * increase. The main program and the handlers each count from their
+         * own previous read, starting at zero.
+         */
+        TIME_MS,
+        /// micros() read: varint increase, counted like TIME_MS
+        TIME_US,
+        /// analogRead(): argument is the channel, varint value
+        ANALOG_IN,
+        /// digitalRead(): argument is the pin, one byte value
+        DIGITAL_IN,
+        /// I2C bytes received: argument is the count, followed by the bytes
+        I2C_IN,
+        /// Serial input: argument is a SerialCall, followed by the value if any
+        SERIAL_IN,
+        /// Interrupt handler invocations: argument is the Vector, varint count
+        INTERRUPT,
+        /// Control record: argument is a Control code
+        CONTROL
+    };
+
+    /// Serial functions, in the argument of a SERIAL_IN record
+    enum SerialCall: uint8_t
+    {
+        /// available(), varint result
+        SERIAL_AVAILABLE,
+        /// read() or peek() of a byte, one byte result
+        SERIAL_READ,
+        SERIAL_PEEK,
+        /// read() or peek() without data
+        SERIAL_READ_NONE,
+        SERIAL_PEEK_NONE
+    };
+
+    /// Control codes, in the argument of a CONTROL record
+    enum Control: uint8_t
+    {
+        /// Synchronization point in HAL_SYNC(), followed by the handler invocations
+        SYNC,
+        /// The recording buffer overflowed, followed by the varint number of lost bytes
+        LOST,
+        /// The previous record is repeated, varint number of repeats
+        REPEAT,
+        /// Codes from here are repeats of the previous record, once for REPEAT_SHORT
+        REPEAT_SHORT
+    };
+
+    /// Interrupt vectors that can be replayed
+    enum Vector: uint8_t
+    {
+        TIMER1_COMPA,
+        EE_READY,
+        nr_vectors
+    };
+
+    /// Start recording, call at the start of setup()
+    static void begin();
+    /// Synchronize with the interrupt handlers, call with interrupts disabled
+    static void sync();
+
+    static uint32_t millis();
+    static uint32_t micros();
+    static int analogRead(uint8_t pin);
+    static int digitalRead(uint8_t pin);
+
+    /// Mark the current invocation of an interrupt handler as an event
+    static void isrEvent();
+
+    /// Marks the lifetime of an interrupt handler invocation
+    class IsrScope
+    {
+    public:
+        IsrScope(Vector vector) { isrEnter(vector); }
+        ~IsrScope() { isrLeave(); }
+    };
+
+private:
+    static void isrEnter(Vector vector);
+    static void isrLeave();
+};
+
+/// Wrapper around Wire, recording or replaying the received bytes
+class HalWire
+{
+public:
+    void begin() { Wire.begin(); }
+    void beginTransmission(uint8_t addr) { Wire.beginTransmission(addr); }
+    void beginTransmission(int addr) { Wire.beginTransmission(addr); }
+    uint8_t endTransmission(bool stop=true) { return Wire.endTransmission(stop); }
+    size_t write(uint8_t b) { return Wire.write(b); }
+    size_t write(const uint8_t* data, size_t len) { return Wire.write(data, len); }
+
+    uint8_t requestFrom(uint8_t addr, uint8_t len, uint8_t stop=true);
+    uint8_t requestFrom(int addr, int len, int stop=1)
+    {
+        return requestFrom(uint8_t(addr), uint8_t(len), uint8_t(stop));
+    }
+    int available() { return _len - _pos; }
+    int read() { return _pos < _len ? _buf[_pos++] : -1; }
+
+private:
+    uint8_t _buf[BUFFER_LENGTH];
+    uint8_t _len = 0;
+    uint8_t _pos = 0;
+};
+
+/**
+ * Wrapper around Serial
+ *
+ * When recording, output is dropped and input is recorded. When replaying,
+ * output goes to the host's Serial and input comes from the recording.
+ */
+class HalSerial: public Print
+{
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    int peek();
+    void flush() {}
+    /// Output is never really sent, so there is always room for it
+    int availableForWrite() override { return 63; }
+    size_t write(uint8_t b) override;
+    using Print::write;
+};
+
+extern HalWire hal_wire;
+extern HalSerial hal_serial;
+
+#if defined(HAL_RECORD) || defined(HAL_REPLAY)
+
+#define millis() Hal::millis()
+#define micros() Hal::micros()
+#define analogRead(pin) Hal::analogRead(pin)
+#define digitalRead(pin) Hal::digitalRead(pin)
+#define Wire hal_wire
+#define Serial hal_serial
+
+#define HAL_BEGIN() Hal::begin()
+#define HAL_SYNC() Hal::sync()
+#define HAL_ISR(vector) Hal::IsrScope hal_isr_scope(Hal::vector)
+#define HAL_ISR_EVENT() Hal::isrEvent()
+
+#else
+
+#define HAL_BEGIN() ((void)0)
+#define HAL_SYNC() ((void)0)
+#define HAL_ISR(vector) ((void)0)
+#define HAL_ISR_EVENT() ((void)0)
+
+#endif
+
+#endif // HAL_H
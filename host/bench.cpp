@@ -0,0 +1,262 @@
+/*
+ * Microbenchmarks for the robot code on the host
+ *
+ * Every benchmark runs its function for a number of iterations, calibrated so
+ * that a run takes at least min_run_ns, and reports the time per call of the
+ * fastest of nr_runs runs. Only benchmarks whose name contains one of the
+ * command line arguments are run, or all of them without arguments.
+ *
+ * Before the benchmarks, a few checks verify edge cases of the benchmarked
+ * code that the benchmarks themselves would not notice; the program fails
+ * if one of them does not hold.
+ *
+ * Note that on the AVR a double is a 32 bit float, so the timings of the
+ * floating point code are only useful for comparing versions of that code.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <Arduino.h>
+#include "blackbox.h"
+#include "eepromlayout.h"
+#include "engine.h"
+#include "eyes.h"
+#include "song.h"
+#include "synth.h"
+#include "utility/quaternion.h"
+
+namespace
+{
+
+const uint64_t min_run_ns = 50000000;
+const int nr_runs = 5;
+
+/// Prevent the compiler from optimizing away the computation of \a value
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)(uint64_t iterations);
+};
+
+constexpr char bench_tune[] PROGMEM = "AGECDBFcAGECDBFc";
+
+void benchInfraredVoltToCm(uint64_t iterations)
+{
+    for (uint64_t i = 0; i < iterations; ++i)
+        doNotOptimize(Eyes::infraredVoltToCm(i & 0x3ff));
+}
+
+void benchSongUpdate(uint64_t iterations)
+{
+    static Synth synth;
+    Song song = Song::compile<bench_tune, 100, 7>(&synth);
+    uint32_t now = millis();
+    song.start();
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        // Advance 1 ms per call, like a fast main loop
+        song.update(++now);
+        if (song.finished())
+            song.start();
+    }
+}
+
+void benchSynthTick(uint64_t iterations)
+{
+    static Synth synth;
+    const Synth::Envelope envelope = { 0, 4, 160, 16 };
+    for (uint8_t v = 0; v < Synth::nr_voices; ++v)
+    {
+        synth.setVoice(v, Synth::Waveform(v % 3), envelope);
+        synth.noteOn(v, 440 + 110*v, 60000);
+    }
+    for (uint64_t i = 0; i < iterations; ++i)
+        synth.tick();
+}
+
+void benchRotateVector(uint64_t iterations)
+{
+    imu::Quaternion q(0.9238795, 0.0, 0.0, 0.3826834);
+    imu::Vector<3> v(1.0, 2.0, 3.0);
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        doNotOptimize(v);
+        imu::Vector<3> r = q.rotateVector(v);
+        doNotOptimize(r);
+    }
+}
+
+void benchMatrixInverted(uint64_t iterations)
+{
+    imu::Matrix<3> m;
+    m(0, 0) = 2; m(0, 1) = 1; m(0, 2) = 0;
+    m(1, 0) = 1; m(1, 1) = 3; m(1, 2) = 1;
+    m(2, 0) = 0; m(2, 1) = 1; m(2, 2) = 4;
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        doNotOptimize(m);
+        imu::Matrix<3> inv = m.inverted();
+        doNotOptimize(inv);
+    }
+}
+
+void benchEngineUpdate(uint64_t iterations)
+{
+    static Adafruit_MotorShield shield;
+    static Engine engine(&shield);
+    engine.setAcceleration(64, 128);
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        // Keep the engine ramping between full speed ahead and a sharp turn
+        if (engine.atTarget())
+        {
+            if (engine.speedLeft() == engine.speedRight())
+                engine.setTargetTurn(200, 160);
+            else
+                engine.setTargetSpeed(255);
+        }
+        engine.update();
+    }
+}
+
+void benchEEPromLayoutRead(uint64_t iterations)
+{
+    Engine::Calibration cal;
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        doNotOptimize(EEPromLayout::read<EEPromLayout::EngineCalibration>(
+            &cal, sizeof(cal)));
+        doNotOptimize(cal);
+    }
+}
+
+void benchBlackBoxRecord(uint64_t iterations)
+{
+    static EEPromLog log;
+    static BlackBox black_box(log);
+    BlackBox::Frame frame = { { 80, 120, 100 }, 0, 40, 40, 0, 10 };
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        // A robot slowly approaching a wall, with some sensor noise
+        frame.dist[0] = 80 - (i >> 4 & 0x3f) + (i & 1);
+        frame.loop_ms = 10 + (i & 3);
+        black_box.record(frame);
+    }
+}
+
+/**
+ * Check that Engine::update() moves the speeds monotonically from 8 bit
+ * speed \a from to \a to, and reaches \a to. The speeds are chosen so that
+ * the last step is smaller than the acceleration limit.
+ */
+bool checkEngineRamp(int from, int to)
+{
+    Adafruit_MotorShield shield;
+    Engine engine(&shield);
+    engine.setAcceleration(Engine::max_speed, Engine::max_speed);
+    engine.setTargetSpeed(from);
+    engine.update();
+    engine.setAcceleration(128, 256);
+    engine.setTargetSpeed(to);
+
+    int prev = engine.speedLeft();
+    for (int i = 0; i < 100 && !engine.atTarget(); ++i)
+    {
+        engine.update();
+        int speed = engine.speedLeft();
+        if ((to > from && speed < prev) || (to < from && speed > prev))
+            break;
+        prev = speed;
+    }
+    // The 12 bit target speed, reached in a single update without limits
+    Engine reference(&shield);
+    reference.setTargetSpeed(to);
+    reference.update();
+    if (engine.atTarget() && engine.speedLeft() == reference.speedLeft())
+        return true;
+    fprintf(stderr, "check failed: engine ramp from %d to %d ends at %d\n",
+        from, to, engine.speedLeft());
+    return false;
+}
+
+bool runChecks()
+{
+    // Stopping and slowing down with a last step below the deceleration,
+    // speeding up with a last step below the acceleration, and reversing
+    static const int ramps[][2] = {
+        { 12, 0 }, { -12, 0 }, { -6, -3 }, { 6, 3 }, { 0, 5 }, { 0, -5 },
+        { 200, -30 }, { -200, 30 }
+    };
+    bool ok = true;
+    for (const auto& r: ramps)
+        ok = checkEngineRamp(r[0], r[1]) && ok;
+    return ok;
+}
+
+const Benchmark benchmarks[] = {
+    { "Eyes::infraredVoltToCm", benchInfraredVoltToCm },
+    { "Song::update", benchSongUpdate },
+    { "Synth::tick", benchSynthTick },
+    { "Quaternion::rotateVector", benchRotateVector },
+    { "Matrix<3>::inverted", benchMatrixInverted },
+    { "Engine::update", benchEngineUpdate },
+    { "EEPromLayout::read", benchEEPromLayoutRead },
+    { "BlackBox::record", benchBlackBoxRecord }
+};
+
+uint64_t timeRun(const Benchmark& bench, uint64_t iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bench.run(iterations);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+double measure(const Benchmark& bench)
+{
+    // Double the number of iterations until a run takes long enough
+    uint64_t iterations = 1;
+    uint64_t ns = timeRun(bench, iterations);
+    while (ns < min_run_ns)
+    {
+        iterations *= 2;
+        ns = timeRun(bench, iterations);
+    }
+
+    for (int i = 1; i < nr_runs; ++i)
+        ns = std::min(ns, timeRun(bench, iterations));
+    return double(ns) / iterations;
+}
+
+bool selected(const char* name, int argc, char* argv[])
+{
+    if (argc < 2)
+        return true;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strstr(name, argv[i]))
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (!runChecks())
+        return 1;
+
+    for (const Benchmark& bench: benchmarks)
+    {
+        if (selected(bench.name, argc, argv))
+            printf("%-28s %10.2f ns/op\n", bench.name, measure(bench));
+    }
+    return 0;
+}
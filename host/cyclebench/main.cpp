@@ -0,0 +1,221 @@
+/*
+ * Cycle counts of the robot code on the ATmega328P
+ *
+ * Runs the benchmark sketch in ../../CycleBench in the simavr emulator, and
+ * prints the number of CPU cycles per call of every benchmark as a tab
+ * separated table, with the minimum, mean and maximum over all calls. The
+ * sketch writes the number of a benchmark to GPIOR0 before every call and
+ * zero after it; the cycles between these writes, less the least number of
+ * cycles between two writes without a call, are the cost of the call. The
+ * benchmarks talk to an I2C device that acknowledges every address and byte.
+ *
+ * Usage: cyclebench [-l label] firmware.elf
+ *   -l label    add a first column with this label, e.g. the commit id, so
+ *               that the tables of several versions can be concatenated
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <avr_twi.h>
+#include <avr_uart.h>
+
+namespace
+{
+
+const char* const mcu = "atmega328p";
+const uint32_t frequency = 16000000;
+// Give up when the benchmarks are not done after this many cycles
+const avr_cycle_count_t max_cycles = 120ull * frequency;
+// Data space address of GPIOR0, and the value ending the run
+const avr_io_addr_t gpior0 = 0x3e;
+const uint8_t done_marker = 0xff;
+// Name of the benchmark measuring the markers themselves
+const char* const overhead_name = "overhead";
+
+struct Benchmark
+{
+    std::string name;
+    std::vector<avr_cycle_count_t> cycles;
+};
+
+std::map<uint8_t, Benchmark> benchmarks;
+uint8_t current = 0;
+avr_cycle_count_t start = 0;
+bool done = false;
+std::string line;
+
+avr_irq_t* twi_irq;
+uint8_t twi_selected = 0;
+uint8_t twi_data = 0;
+
+void onMarker(avr_t* avr, avr_io_addr_t addr, uint8_t value, void*)
+{
+    avr->data[addr] = value;
+    if (value == done_marker)
+    {
+        done = true;
+    }
+    else if (value)
+    {
+        current = value;
+        start = avr->cycle;
+    }
+    else if (current)
+    {
+        benchmarks[current].cycles.push_back(avr->cycle - start);
+        current = 0;
+    }
+}
+
+void onUart(avr_irq_t*, uint32_t value, void*)
+{
+    // Benchmarks are announced with a "<number> <name>" line
+    if (value == '\n')
+    {
+        char* end;
+        unsigned long id = strtoul(line.c_str(), &end, 10);
+        if (end != line.c_str() && *end == ' ' && id > 0 && id < done_marker)
+            benchmarks[id].name = end + 1;
+        line.clear();
+    }
+    else if (value != '\r')
+    {
+        line += char(value);
+    }
+}
+
+// An I2C device answering to every address. Reads return a counting pattern,
+// so that the sensor decoding works on changing data.
+void onTwi(avr_irq_t*, uint32_t value, void*)
+{
+    avr_twi_msg_irq_t msg;
+    msg.u.v = value;
+
+    if (msg.u.twi.msg & TWI_COND_STOP)
+        twi_selected = 0;
+    if (msg.u.twi.msg & TWI_COND_START)
+    {
+        twi_selected = msg.u.twi.addr;
+        avr_raise_irq(twi_irq + TWI_IRQ_INPUT,
+            avr_twi_irq_msg(TWI_COND_ACK, twi_selected, 1));
+    }
+    if (twi_selected && (msg.u.twi.msg & TWI_COND_WRITE))
+    {
+        avr_raise_irq(twi_irq + TWI_IRQ_INPUT,
+            avr_twi_irq_msg(TWI_COND_ACK, twi_selected, 1));
+    }
+    if (twi_selected && (msg.u.twi.msg & TWI_COND_READ))
+    {
+        avr_raise_irq(twi_irq + TWI_IRQ_INPUT,
+            avr_twi_irq_msg(TWI_COND_READ, twi_selected, twi_data++));
+    }
+}
+
+void attachDevices(avr_t* avr)
+{
+    avr_register_io_write(avr, gpior0, onMarker, nullptr);
+
+    // Capture the serial output instead of echoing it
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+        onUart, nullptr);
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    twi_irq = avr_alloc_irq(&avr->irq_pool, 0, TWI_IRQ_COUNT, nullptr);
+    avr_irq_register_notify(twi_irq + TWI_IRQ_OUTPUT, onTwi, nullptr);
+    avr_connect_irq(twi_irq + TWI_IRQ_INPUT,
+        avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT),
+        twi_irq + TWI_IRQ_OUTPUT);
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: cyclebench [-l label] firmware.elf\n");
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* label = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': label = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind + 1 != argc)
+        usage();
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[optind], &firmware) != 0)
+    {
+        fprintf(stderr, "cannot read firmware %s\n", argv[optind]);
+        return 2;
+    }
+    strcpy(firmware.mmcu, mcu);
+    firmware.frequency = frequency;
+
+    avr_t* avr = avr_make_mcu_by_name(mcu);
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    attachDevices(avr);
+
+    int state = cpu_Running;
+    while (!done && (state == cpu_Running || state == cpu_Sleeping)
+            && avr->cycle < max_cycles)
+        state = avr_run(avr);
+    if (!done)
+    {
+        fprintf(stderr, "the benchmarks did not finish\n");
+        return 1;
+    }
+
+    // The cost of the markers themselves
+    avr_cycle_count_t overhead = 0;
+    for (const auto& b: benchmarks)
+    {
+        if (b.second.name == overhead_name && !b.second.cycles.empty())
+            overhead = *std::min_element(b.second.cycles.begin(), b.second.cycles.end());
+    }
+
+    printf("%sbenchmark\tcalls\tmin_cycles\tmean_cycles\tmax_cycles\n", label ? "label\t" : "");
+    for (const auto& b: benchmarks)
+    {
+        const std::vector<avr_cycle_count_t>& cycles = b.second.cycles;
+        if (b.second.name == overhead_name || cycles.empty())
+            continue;
+
+        avr_cycle_count_t lo = cycles[0], hi = cycles[0], sum = 0;
+        for (avr_cycle_count_t c: cycles)
+        {
+            lo = std::min(lo, c);
+            hi = std::max(hi, c);
+            sum += c;
+        }
+        if (label)
+            printf("%s\t", label);
+        printf("%s\t%zu\t%llu\t%.1f\t%llu\n", b.second.name.c_str(), cycles.size(),
+            (unsigned long long)(lo - overhead),
+            double(sum) / cycles.size() - overhead,
+            (unsigned long long)(hi - overhead));
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Replayer of HAL recordings
+ *
+ * Runs the robot code in Robot.ino on the inputs recorded on the robot by a
+ * build with HAL_RECORD defined, see hal.h, and prints what the code did
+ * with them: the motor commands sent to the motor shield, the telemetry
+ * frames written to the serial port, as their COBS encoded bytes in hex,
+ * and the digital outputs, each with the time in ms at which they
+ * happened. The replay stops at the end of the recording, where the
+ * recording lost data, or where the code stops reading what was recorded,
+ * for instance because it was changed since the recording.
+ *
+ * Usage: replay [options] recording
+ *   -i          also print every I2C write transaction
+ *   -q          only print the summary
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "player.h"
+#include "../sim/shieldmodel.h"
+
+// The replayer talks to the host's Wire, not to the robot code's wrapper
+#undef Wire
+
+// Entry points of the sketch
+void setup();
+void loop();
+
+namespace
+{
+
+const char* const motor_names[] = { "left", "right" };
+
+ShieldModel shield;
+ShieldModel::Drive drive[2] = { ShieldModel::RELEASED, ShieldModel::RELEASED };
+uint16_t pwm[2] = { 0, 0 };
+bool show_i2c = false;
+bool quiet = false;
+
+void onI2CWrite(uint8_t addr, const uint8_t* data, uint8_t len)
+{
+    if (show_i2c && !quiet)
+    {
+        printf("%u i2c %02x:", player.ms(), addr);
+        for (uint8_t i = 0; i < len; ++i)
+            printf(" %02x", data[i]);
+        printf("\n");
+    }
+    if (!shield.write(addr, data, len))
+        return;
+
+    // The left motor is on port 1, the right one on port 2
+    for (uint8_t m = 0; m < 2; ++m)
+    {
+        uint16_t value;
+        ShieldModel::Drive d = shield.motor(m, value);
+        if (d == drive[m] && value == pwm[m])
+            continue;
+        drive[m] = d;
+        pwm[m] = value;
+        if (!quiet)
+            printf("%u motor %s %s %u\n", player.ms(), motor_names[m],
+                ShieldModel::driveName(d), value);
+    }
+}
+
+void onPinWrite(uint8_t pin, uint8_t val)
+{
+    if (!quiet)
+        printf("%u pin %u %u\n", player.ms(), pin, val);
+}
+
+void onSerialFrame(const uint8_t* data, size_t len)
+{
+    if (quiet)
+        return;
+    printf("%u serial", player.ms());
+    for (size_t i = 0; i < len; ++i)
+        printf(" %02x", data[i]);
+    printf("\n");
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: replay [-i] [-q] recording\n");
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "iq")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i': show_i2c = true; break;
+            case 'q': quiet = true; break;
+            default: usage();
+        }
+    }
+    if (optind + 1 != argc)
+        usage();
+
+    std::string error;
+    if (!player.load(argv[optind], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+
+    // Time only passes in the recording
+    hostUseVirtualClock();
+    hostSetPinHandlers(onPinWrite, nullptr);
+    Wire.hostSetDevice(onI2CWrite, nullptr);
+    player.setSerialHandler(onSerialFrame);
+
+    uint64_t passes = 0;
+    bool diverged = false;
+    try
+    {
+        setup();
+        for (;;)
+        {
+            loop();
+            ++passes;
+        }
+    }
+    catch (const Player::End& end)
+    {
+        fprintf(stderr, "replayed %.3f s, %llu passes through loop(), %llu interrupts: %s\n",
+            player.ms() / 1000.0, (unsigned long long)passes,
+            (unsigned long long)player.invocations(), end.what());
+        diverged = end.diverged();
+    }
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <avr/eeprom.h>
+#include "player.h"
+
+#ifndef HAL_REPLAY
+#error "The replayer should be built with HAL_REPLAY defined"
+#endif
+
+// This file implements the wrappers, so it needs the real functions
+#undef millis
+#undef micros
+#undef analogRead
+#undef digitalRead
+#undef Wire
+#undef Serial
+
+// Interrupt handlers of the sketch
+extern "C" void TIMER1_COMPA_vect();
+extern "C" void EE_READY_vect();
+
+Player player;
+HalWire hal_wire;
+HalSerial hal_serial;
+
+namespace
+{
+
+void (* const vectors[Hal::nr_vectors])() = {
+    TIMER1_COMPA_vect,
+    EE_READY_vect
+};
+
+const char* const type_names[] = {
+    "TIME_MS", "TIME_US", "ANALOG_IN", "DIGITAL_IN", "I2C_IN", "SERIAL_IN",
+    "INTERRUPT", "CONTROL"
+};
+
+std::string at(size_t pos)
+{
+    return " at offset " + std::to_string(pos);
+}
+
+} // namespace
+
+bool Player::load(const char* path, std::string& error)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        _data.insert(_data.end(), buf, buf + n);
+    fclose(f);
+
+    // The stream starts at the magic number, earlier bytes may be left over
+    // from before the robot was reset
+    uint8_t magic[4];
+    for (uint8_t i = 0; i < 4; ++i)
+        magic[i] = uint8_t(Hal::magic >> (8*i));
+    size_t start = 0;
+    while (start + 4 <= _data.size() && memcmp(&_data[start], magic, 4) != 0)
+        ++start;
+    if (start + 4 + E2END + 1 > _data.size())
+    {
+        error = std::string(path) + " is not a HAL recording";
+        return false;
+    }
+    memcpy(host_eeprom, &_data[start + 4], E2END + 1);
+    _pos = _last = start + 4 + E2END + 1;
+    return true;
+}
+
+Player::Record Player::take(Hal::RecordType type)
+{
+    Record rec;
+    if (_in_isr)
+    {
+        size_t pos = _pos;
+        _pos = _parse(pos, rec);
+        if (rec.type != type)
+            throw End(std::string("handler read ") + type_names[type] + ", recorded "
+                + type_names[rec.type] + at(pos), true);
+        return rec;
+    }
+
+    if (_repeats == 0)
+    {
+        Record ctl;
+        if (_nextIs(Hal::REPEAT))
+        {
+            _pos = _parse(_pos, ctl);
+            _repeats = ctl.value;
+        }
+        else if (_peek() == Hal::CONTROL && !_nextIs(Hal::SYNC) && !_nextIs(Hal::LOST))
+        {
+            _pos = _parse(_pos, ctl);
+            _repeats = ctl.arg - Hal::REPEAT_SHORT + 1;
+        }
+    }
+
+    size_t pos;
+    if (_repeats)
+    {
+        --_repeats;
+        pos = _last;
+        _parse(pos, rec);
+    }
+    else
+    {
+        _runInterrupts();
+        pos = _last = _pos;
+        _pos = _parse(pos, rec);
+    }
+    if (rec.type != type)
+        throw End(std::string("read ") + type_names[type] + ", recorded "
+            + type_names[rec.type] + at(pos), true);
+    return rec;
+}
+
+void Player::sync()
+{
+    if (_repeats == 0 && _pos < _data.size() && _nextIs(Hal::SYNC))
+    {
+        ++_pos;
+        _runInterrupts();
+    }
+}
+
+void Player::serialWrite(uint8_t b)
+{
+    if (b == 0)
+    {
+        // Skip the empty frame at the start of the stream
+        if (_on_frame && !_frame.empty())
+            _on_frame(_frame.data(), _frame.size());
+        _frame.clear();
+    }
+    else
+    {
+        _frame.push_back(b);
+    }
+}
+
+size_t Player::_parse(size_t pos, Record& rec) const
+{
+    if (pos >= _data.size())
+        throw End("end of recording", false);
+
+    rec.type = Hal::RecordType(_data[pos] >> 5);
+    rec.arg = _data[pos] & 0x1f;
+    rec.value = 0;
+    rec.data = nullptr;
+    size_t start = pos++;
+    switch (rec.type)
+    {
+        case Hal::TIME_MS:
+            rec.value = rec.arg < 31 ? rec.arg : _varint(pos);
+            break;
+        case Hal::TIME_US:
+        case Hal::ANALOG_IN:
+        case Hal::INTERRUPT:
+            rec.value = _varint(pos);
+            break;
+        case Hal::DIGITAL_IN:
+            if (pos >= _data.size())
+                throw End("end of recording", false);
+            rec.value = _data[pos++];
+            break;
+        case Hal::I2C_IN:
+            rec.value = rec.arg;
+            if (rec.arg == 31)
+            {
+                if (pos >= _data.size())
+                    throw End("end of recording", false);
+                rec.value = _data[pos++];
+            }
+            if (pos + rec.value > _data.size())
+                throw End("end of recording", false);
+            rec.data = &_data[pos];
+            pos += rec.value;
+            break;
+        case Hal::SERIAL_IN:
+            if (rec.arg == Hal::SERIAL_AVAILABLE)
+            {
+                rec.value = _varint(pos);
+            }
+            else if (rec.arg == Hal::SERIAL_READ || rec.arg == Hal::SERIAL_PEEK)
+            {
+                if (pos >= _data.size())
+                    throw End("end of recording", false);
+                rec.value = _data[pos++];
+            }
+            break;
+        case Hal::CONTROL:
+            if (rec.arg == Hal::LOST)
+                throw End("recording lost " + std::to_string(_varint(pos))
+                    + " bytes" + at(start), false);
+            if (rec.arg == Hal::REPEAT)
+                rec.value = _varint(pos);
+            break;
+    }
+    return pos;
+}
+
+Hal::RecordType Player::_peek() const
+{
+    if (_pos >= _data.size())
+        throw End("end of recording", false);
+    return Hal::RecordType(_data[_pos] >> 5);
+}
+
+bool Player::_nextIs(Hal::Control code) const
+{
+    return _peek() == Hal::CONTROL && (_data[_pos] & 0x1f) == code;
+}
+
+void Player::_runInterrupts()
+{
+    while (_peek() == Hal::INTERRUPT)
+    {
+        Record rec;
+        size_t pos = _pos;
+        _pos = _parse(pos, rec);
+        if (rec.arg >= Hal::nr_vectors)
+            throw End("unknown interrupt vector" + at(pos), false);
+        _in_isr = true;
+        for (uint32_t i = 0; i < rec.value; ++i)
+        {
+            vectors[rec.arg]();
+            ++_invocations;
+        }
+        _in_isr = false;
+    }
+}
+
+uint32_t Player::_varint(size_t& pos) const
+{
+    uint32_t value = 0;
+    for (uint8_t shift = 0; ; shift += 7)
+    {
+        if (pos >= _data.size())
+            throw End("end of recording", false);
+        uint8_t b = _data[pos++];
+        value |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return value;
+    }
+}
+
+void Hal::begin()
+{
+    // The EEPROM contents were loaded with the recording
+}
+
+void Hal::sync()
+{
+    player.sync();
+}
+
+uint32_t Hal::millis()
+{
+    return player.advanceMs(player.take(TIME_MS).value);
+}
+
+uint32_t Hal::micros()
+{
+    return player.advanceUs(player.take(TIME_US).value);
+}
+
+int Hal::analogRead(uint8_t pin)
+{
+    Player::Record rec = player.take(ANALOG_IN);
+    if (rec.arg != ((pin >= A0 ? pin - A0 : pin) & 0x1f))
+        throw Player::End("analogRead() of another channel" + at(player.offset()), true);
+    return rec.value;
+}
+
+int Hal::digitalRead(uint8_t pin)
+{
+    Player::Record rec = player.take(DIGITAL_IN);
+    if (rec.arg != (pin & 0x1f))
+        throw Player::End("digitalRead() of another pin" + at(player.offset()), true);
+    return rec.value;
+}
+
+void Hal::isrEvent() {}
+void Hal::isrEnter(Vector) {}
+void Hal::isrLeave() {}
+
+uint8_t HalWire::requestFrom(uint8_t addr, uint8_t len, uint8_t stop)
+{
+    // Let the host's Wire count the transaction, but use the recorded bytes
+    Wire.requestFrom(addr, len, stop);
+    Player::Record rec = player.take(Hal::I2C_IN);
+    _len = min(rec.value, uint32_t(BUFFER_LENGTH));
+    memcpy(_buf, rec.data, _len);
+    _pos = 0;
+    return _len;
+}
+
+void HalSerial::begin(unsigned long) {}
+
+int HalSerial::available()
+{
+    Player::Record rec = player.take(Hal::SERIAL_IN);
+    if (rec.arg != Hal::SERIAL_AVAILABLE)
+        throw Player::End("Serial.available() not recorded" + at(player.offset()), true);
+    return rec.value;
+}
+
+int HalSerial::read()
+{
+    Player::Record rec = player.take(Hal::SERIAL_IN);
+    if (rec.arg == Hal::SERIAL_READ_NONE)
+        return -1;
+    if (rec.arg != Hal::SERIAL_READ)
+        throw Player::End("Serial.read() not recorded" + at(player.offset()), true);
+    return rec.value;
+}
+
+int HalSerial::peek()
+{
+    Player::Record rec = player.take(Hal::SERIAL_IN);
+    if (rec.arg == Hal::SERIAL_PEEK_NONE)
+        return -1;
+    if (rec.arg != Hal::SERIAL_PEEK)
+        throw Player::End("Serial.peek() not recorded" + at(player.offset()), true);
+    return rec.value;
+}
+
+size_t HalSerial::write(uint8_t b)
+{
+    player.serialWrite(b);
+    return 1;
+}
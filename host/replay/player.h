@@ -0,0 +1,113 @@
+#ifndef REPLAY_PLAYER_H
+#define REPLAY_PLAYER_H
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "hal.h"
+
+/**
+ * Player of a HAL recording
+ *
+ * Supplies the inputs read through the Hal functions from a recording made
+ * on the robot, and runs the interrupt handlers at the points where they
+ * ran on the robot. See hal.h for the format of the recording.
+ */
+class Player
+{
+public:
+    /// A record from the recording
+    struct Record
+    {
+        Hal::RecordType type;
+        uint8_t arg;
+        /// The varint or byte value, or the number of bytes in \c data
+        uint32_t value;
+        const uint8_t* data;
+    };
+
+    /// Thrown when the replay cannot go on
+    class End: public std::runtime_error
+    {
+    public:
+        End(const std::string& what, bool diverged):
+            std::runtime_error(what), _diverged(diverged) {}
+        /// Return \c true if the robot code did not read what was recorded
+        bool diverged() const { return _diverged; }
+
+    private:
+        bool _diverged;
+    };
+
+    /**
+     * Load the recording in file \a path, and put the EEPROM image at its
+     * start in the EEPROM of the host. Returns \c false and sets \a error if
+     * the file cannot be read or is not a recording.
+     */
+    bool load(const char* path, std::string& error);
+
+    /**
+     * Take the next record, which should be of type \a type. When called from
+     * the main program, the interrupt handlers that ran before the read on
+     * the robot are run first. Throws End at the end of the recording, or
+     * when the next record does not match.
+     */
+    Record take(Hal::RecordType type);
+    /// Handle a synchronization point of the main program
+    void sync();
+
+    /**
+     * Install a handler for the frames the robot code writes to the serial
+     * port. The output is split at the zero bytes that delimit telemetry
+     * frames, see telemetry.h; the handler gets the bytes between them.
+     */
+    void setSerialHandler(void (*on_frame)(const uint8_t* data, size_t len))
+    {
+        _on_frame = on_frame;
+    }
+    /// Handle byte \a b written to the serial port by the robot code
+    void serialWrite(uint8_t b);
+
+    /// Return the time in ms last read by the main program
+    uint32_t ms() const { return _ms[0]; }
+    /// Return the time in µs last read by the main program
+    uint32_t us() const { return _us[0]; }
+    /// Advance the time in ms of the reading context by \a delta, and return it
+    uint32_t advanceMs(uint32_t delta) { return _ms[_in_isr] += delta; }
+    /// Advance the time in µs of the reading context by \a delta, and return it
+    uint32_t advanceUs(uint32_t delta) { return _us[_in_isr] += delta; }
+    /// Return the offset of the next record
+    size_t offset() const { return _pos; }
+    /// Return the number of interrupt handler invocations so far
+    uint64_t invocations() const { return _invocations; }
+
+private:
+    std::vector<uint8_t> _data;
+    size_t _pos = 0;
+    /// Offset of the last record taken by the main program
+    size_t _last = 0;
+    /// Number of repeats of the last record still to be taken
+    uint32_t _repeats = 0;
+    bool _in_isr = false;
+    uint32_t _ms[2] = { 0, 0 };
+    uint32_t _us[2] = { 0, 0 };
+    uint64_t _invocations = 0;
+    void (*_on_frame)(const uint8_t* data, size_t len) = nullptr;
+    std::vector<uint8_t> _frame;
+
+    /// Parse the record at offset \a pos into \a rec, and return the offset after it
+    size_t _parse(size_t pos, Record& rec) const;
+    /// Return the type of the next record, failing at the end of the recording
+    Hal::RecordType _peek() const;
+    /// Return \c true if the next record is control record \a code
+    bool _nextIs(Hal::Control code) const;
+    /// Run the interrupt handler invocations at the current offset
+    void _runInterrupts();
+    /// Return a varint at offset \a pos, and advance \a pos
+    uint32_t _varint(size_t& pos) const;
+};
+
+/// The recording being replayed
+extern Player player;
+
+#endif // REPLAY_PLAYER_H
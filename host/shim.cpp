@@ -0,0 +1,330 @@
+/*
+ * Implementation of the host Arduino API, see shim/Arduino.h
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <EEPROM.h>
+#include <Wire.h>
+
+namespace
+{
+
+const uint8_t nr_pins = 22;
+
+int analog_values[nr_pins];
+int (*on_analog_read)(uint8_t pin) = nullptr;
+uint8_t pin_values[nr_pins];
+void (*on_pin_write)(uint8_t pin, uint8_t val) = nullptr;
+int (*on_pin_read)(uint8_t pin) = nullptr;
+unsigned int tone_frequencies[nr_pins];
+std::deque<uint8_t> serial_input;
+
+std::chrono::steady_clock::time_point startTime()
+{
+    static const std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    return start;
+}
+
+bool virtual_clock = false;
+uint64_t virtual_us = 0;
+void (*on_delay)(uint32_t us) = nullptr;
+
+uint64_t elapsedMicros()
+{
+    if (virtual_clock)
+        return virtual_us;
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime()).count();
+}
+} // namespace
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+uint8_t host_eeprom[1024];
+
+namespace
+{
+
+struct StartUp
+{
+    StartUp()
+    {
+        // Let the time start at program start up, rather than at the first call
+        startTime();
+        // Erased EEPROM reads as all ones
+        memset(host_eeprom, 0xff, sizeof(host_eeprom));
+    }
+} start_up;
+
+} // namespace
+
+volatile uint8_t TIMSK0, TCNT0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+volatile uint8_t EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t GPIOR0, SREG;
+HostEECR EECR;
+
+uint32_t millis()
+{
+    return elapsedMicros() / 1000;
+}
+
+uint32_t micros()
+{
+    return elapsedMicros();
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (!virtual_clock)
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    else if (on_delay)
+        on_delay(us);
+    else
+        virtual_us += us;
+}
+
+void delay(uint32_t ms)
+{
+    if (!virtual_clock)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    else
+        delayMicroseconds(ms * 1000);
+}
+
+void hostUseVirtualClock(void (*handler)(uint32_t us))
+{
+    virtual_clock = true;
+    virtual_us = 0;
+    on_delay = handler;
+}
+
+void hostSetMicros(uint64_t us)
+{
+    virtual_us = us;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < nr_pins)
+        pin_values[pin] = val;
+    if (on_pin_write)
+        on_pin_write(pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (on_pin_read)
+        return on_pin_read(pin);
+    return pin < nr_pins ? pin_values[pin] : LOW;
+}
+
+void hostSetPinHandlers(void (*on_write)(uint8_t pin, uint8_t val),
+    int (*on_read)(uint8_t pin))
+{
+    on_pin_write = on_write;
+    on_pin_read = on_read;
+}
+
+int analogRead(uint8_t pin)
+{
+    // Like the Arduino core, accept both channel and pin numbers
+    if (pin < A0)
+        pin += A0;
+    if (on_analog_read)
+        return on_analog_read(pin);
+    pin -= A0;
+    return pin < nr_pins ? analog_values[pin] : 0;
+}
+
+void hostSetAnalogHandler(int (*on_read)(uint8_t pin))
+{
+    on_analog_read = on_read;
+}
+
+void hostSetAnalog(uint8_t pin, int value)
+{
+    if (pin >= A0)
+        pin -= A0;
+    if (pin < nr_pins)
+        analog_values[pin] = value;
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long)
+{
+    if (pin < nr_pins)
+        tone_frequencies[pin] = frequency;
+}
+
+void noTone(uint8_t pin)
+{
+    if (pin < nr_pins)
+        tone_frequencies[pin] = 0;
+}
+
+unsigned int hostToneFrequency(uint8_t pin)
+{
+    return pin < nr_pins ? tone_frequencies[pin] : 0;
+}
+
+int HardwareSerial::available()
+{
+    return serial_input.size();
+}
+
+int HardwareSerial::peek()
+{
+    return serial_input.empty() ? -1 : serial_input.front();
+}
+
+int HardwareSerial::read()
+{
+    if (serial_input.empty())
+        return -1;
+    uint8_t c = serial_input.front();
+    serial_input.pop_front();
+    return c;
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    return _muted ? len : fwrite(buf, 1, len, stdout);
+}
+
+size_t Print::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+        return print('-') + print((unsigned long)-n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(n) + 1];
+    char *p = buf + sizeof(buf);
+    *--p = '\0';
+    do
+    {
+        int digit = n % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n);
+    return print(p);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+void HardwareSerial::hostInput(const char* s)
+{
+    serial_input.insert(serial_input.end(), s, s + strlen(s));
+}
+
+HostEECR& HostEECR::operator=(uint8_t v)
+{
+    if (v & (1 << EERE))
+        EEDR = host_eeprom[EEAR & E2END];
+    if ((v & (1 << EEPE)) && (value & (1 << EEMPE)))
+        host_eeprom[EEAR & E2END] = EEDR;
+    // Reads and writes complete immediately, and the write enable times out
+    value = v & ~((1 << EERE) | (1 << EEPE) | ((v & (1 << EEPE)) ? (1 << EEMPE) : 0));
+    return *this;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* addr)
+{
+    return host_eeprom[uintptr_t(addr) & E2END];
+}
+
+void eeprom_write_byte(uint8_t* addr, uint8_t value)
+{
+    host_eeprom[uintptr_t(addr) & E2END] = value;
+}
+
+void eeprom_update_byte(uint8_t* addr, uint8_t value)
+{
+    eeprom_write_byte(addr, value);
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = static_cast<uint8_t*>(dst);
+    for (size_t i = 0; i < n; ++i)
+        d[i] = eeprom_read_byte(static_cast<const uint8_t*>(src) + i);
+}
+
+void eeprom_write_block(const void* src, void* dst, size_t n)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < n; ++i)
+        eeprom_write_byte(static_cast<uint8_t*>(dst) + i, s[i]);
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+    eeprom_write_block(src, dst, n);
+}
+
+void TwoWire::beginTransmission(uint8_t addr)
+{
+    _addr = addr;
+    _tx_len = 0;
+}
+
+size_t TwoWire::write(uint8_t b)
+{
+    if (_tx_len >= BUFFER_LENGTH)
+        return 0;
+    _tx[_tx_len++] = b;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len)
+{
+    size_t n = 0;
+    while (n < len && write(data[n]))
+        ++n;
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool)
+{
+    ++_transactions;
+    if (_on_write)
+        _on_write(_addr, _tx, _tx_len);
+    _tx_len = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, uint8_t)
+{
+    if (len > BUFFER_LENGTH)
+        len = BUFFER_LENGTH;
+    ++_transactions;
+    memset(_rx, 0, len);
+    if (_on_read)
+        _on_read(addr, _rx, len);
+    _rx_len = len;
+    _rx_pos = 0;
+    return len;
+}
@@ -0,0 +1,45 @@
+#ifndef HOST_ADAFRUIT_SENSOR_H
+#define HOST_ADAFRUIT_SENSOR_H
+
+// The parts of the Adafruit unified sensor library used by the BNO055 driver
+
+#include <stdint.h>
+
+#define SENSOR_TYPE_ORIENTATION 3
+
+typedef struct
+{
+    float x, y, z;
+} sensors_vec_t;
+
+typedef struct
+{
+    int32_t version;
+    int32_t sensor_id;
+    int32_t type;
+    int32_t reserved0;
+    int32_t timestamp;
+    sensors_vec_t orientation;
+} sensors_event_t;
+
+typedef struct
+{
+    char name[12];
+    int32_t version;
+    int32_t sensor_id;
+    int32_t type;
+    float max_value;
+    float min_value;
+    float resolution;
+    int32_t min_delay;
+} sensor_t;
+
+class Adafruit_Sensor
+{
+public:
+    virtual ~Adafruit_Sensor() {}
+    virtual bool getEvent(sensors_event_t*) = 0;
+    virtual void getSensor(sensor_t*) = 0;
+};
+
+#endif // HOST_ADAFRUIT_SENSOR_H
@@ -0,0 +1,209 @@
+/*
+ * Minimal Arduino API for building the robot code on a Linux host
+ *
+ * Only the parts of the Arduino core and avr-libc that are used by the robot
+ * code are provided. Time comes from the host's monotonic clock, analog
+ * inputs return values set with hostSetAnalog(), and the AVR registers are
+ * plain variables without any effect.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "avr/interrupt.h"
+#include "avr/pgmspace.h"
+
+#define ARDUINO_HOST 1
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+enum AnalogPin: uint8_t
+{
+    A0 = 14, A1, A2, A3, A4, A5, A6, A7
+};
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::min;
+using std::max;
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define degrees(rad) ((rad)*57.295779513082320876798154814105)
+#define radians(deg) ((deg)*0.017453292519943295769236907684886)
+
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+inline bool isDigit(char c) { return isdigit(c) != 0; }
+inline long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration=0);
+void noTone(uint8_t pin);
+
+/**
+ * Switch to a virtual clock
+ *
+ * From now on, millis() and micros() return a virtual time starting at zero,
+ * which only changes through hostSetMicros(). Calls to delay() and
+ * delayMicroseconds() are passed on to \a on_delay, which should advance the
+ * time. Without a handler, they advance the time themselves.
+ */
+void hostUseVirtualClock(void (*on_delay)(uint32_t us)=nullptr);
+/// Set the virtual time to \a us microseconds
+void hostSetMicros(uint64_t us);
+/// Set the value returned by analogRead() for \a pin
+void hostSetAnalog(uint8_t pin, int value);
+/// Install a handler that supplies the values returned by analogRead()
+void hostSetAnalogHandler(int (*on_read)(uint8_t pin));
+/// Install handlers called by digitalWrite() and digitalRead()
+void hostSetPinHandlers(void (*on_write)(uint8_t pin, uint8_t val),
+    int (*on_read)(uint8_t pin));
+/// Return the frequency of the last tone() on \a pin, or 0 after noTone()
+unsigned int hostToneFrequency(uint8_t pin);
+
+/// Formatted output, the base class of the serial port
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len)
+    {
+        size_t n = 0;
+        while (len-- && write(*buf++))
+            ++n;
+        return n;
+    }
+    size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+    virtual int availableForWrite() { return 0; }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write(uint8_t(c)); }
+    size_t print(unsigned char n, int base=DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base=DEC) { return print(long(n), base); }
+    size_t print(unsigned int n, int base=DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base=DEC);
+    size_t print(unsigned long n, int base=DEC);
+    size_t print(double n, int digits=2);
+
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+    template <typename T>
+    size_t println(T v, int fmt) { return print(v, fmt) + println(); }
+};
+
+/// Output and input of the serial port, on the host's standard streams
+class HardwareSerial: public Print
+{
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    void flush() {}
+
+    int available();
+    int peek();
+    int read();
+    int availableForWrite() override { return 63; }
+
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+
+    /// Queue \a s as input for read()
+    void hostInput(const char* s);
+    /// Discard all output while \a mute is \c true
+    void hostMute(bool mute) { _muted = mute; }
+
+private:
+    bool _muted = false;
+};
+
+extern HardwareSerial Serial;
+
+// AVR registers touched by the robot code
+extern volatile uint8_t TIMSK0, TCNT0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+extern volatile uint8_t GPIOR0, SREG;
+
+/**
+ * EEPROM data and address registers
+ *
+ * Only the control register has side effects. Setting EERE copies the byte
+ * at EEAR from host_eeprom into EEDR, setting EEPE writes EEDR to it. Writes
+ * complete immediately, so EEPE always reads as zero.
+ */
+extern volatile uint8_t EEDR;
+extern volatile uint16_t EEAR;
+
+struct HostEECR
+{
+    uint8_t value;
+
+    operator uint8_t() const { return value; }
+    HostEECR& operator=(uint8_t v);
+    HostEECR& operator|=(uint8_t mask) { return *this = value | mask; }
+    HostEECR& operator&=(uint8_t mask) { return *this = value & mask; }
+};
+extern HostEECR EECR;
+
+#define TOIE0 0
+#define WGM12 3
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define OCIE1A 1
+#define WGM20 0
+#define WGM21 1
+#define COM2A1 7
+#define CS20 0
+#define TOIE2 0
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+
+#define E2END 0x3FF
+
+#endif // HOST_ARDUINO_H
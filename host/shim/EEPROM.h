@@ -0,0 +1,18 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <avr/eeprom.h>
+#include "Arduino.h"
+
+struct EEPROMClass
+{
+    uint8_t read(int idx) { return host_eeprom[idx]; }
+    void write(int idx, uint8_t val) { host_eeprom[idx] = val; }
+    void update(int idx, uint8_t val) { host_eeprom[idx] = val; }
+    uint8_t& operator[](int idx) { return host_eeprom[idx]; }
+    uint16_t length() { return E2END + 1; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
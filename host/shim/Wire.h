@@ -0,0 +1,63 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+/**
+ * I2C bus
+ *
+ * Transmissions are collected in a buffer like on the Arduino, and handed to
+ * a device handler set with hostSetDevice() when they end. Reads return the
+ * bytes the handler supplies, or zeros if there is no handler.
+ */
+class TwoWire
+{
+public:
+    /// Handler for a write transaction to device \a addr
+    typedef void (*WriteHandler)(uint8_t addr, const uint8_t* data, uint8_t len);
+    /// Handler for a read of \a len bytes from device \a addr into \a data
+    typedef void (*ReadHandler)(uint8_t addr, uint8_t* data, uint8_t len);
+
+    void begin() {}
+    void setClock(uint32_t) {}
+
+    void beginTransmission(uint8_t addr);
+    void beginTransmission(int addr) { beginTransmission(uint8_t(addr)); }
+    uint8_t endTransmission(bool stop=true);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* data, size_t len);
+
+    uint8_t requestFrom(uint8_t addr, uint8_t len, uint8_t stop=true);
+    uint8_t requestFrom(int addr, int len, int stop=1)
+    {
+        return requestFrom(uint8_t(addr), uint8_t(len), uint8_t(stop));
+    }
+    int available() { return _rx_len - _rx_pos; }
+    int read() { return _rx_pos < _rx_len ? _rx[_rx_pos++] : -1; }
+
+    /// Install the handlers simulating the devices on the bus
+    void hostSetDevice(WriteHandler on_write, ReadHandler on_read)
+    {
+        _on_write = on_write;
+        _on_read = on_read;
+    }
+    /// Return the number of transactions since start up
+    uint32_t hostTransactions() const { return _transactions; }
+
+private:
+    WriteHandler _on_write = nullptr;
+    ReadHandler _on_read = nullptr;
+    uint8_t _addr = 0;
+    uint8_t _tx[BUFFER_LENGTH];
+    uint8_t _tx_len = 0;
+    uint8_t _rx[BUFFER_LENGTH];
+    uint8_t _rx_len = 0;
+    uint8_t _rx_pos = 0;
+    uint32_t _transactions = 0;
+};
+
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,18 @@
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint8_t eeprom_read_byte(const uint8_t* addr);
+void eeprom_write_byte(uint8_t* addr, uint8_t value);
+void eeprom_update_byte(uint8_t* addr, uint8_t value);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_write_block(const void* src, void* dst, size_t n);
+void eeprom_update_block(const void* src, void* dst, size_t n);
+inline bool eeprom_is_ready() { return true; }
+
+/// Contents of the simulated EEPROM, initially erased
+extern uint8_t host_eeprom[1024];
+
+#endif // HOST_AVR_EEPROM_H
@@ -0,0 +1,10 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+// Interrupt handlers become plain functions, which the host code can call
+#define ISR(vector) extern "C" void vector()
+
+#define cli() ((void)0)
+#define sei() ((void)0)
+
+#endif // HOST_AVR_INTERRUPT_H
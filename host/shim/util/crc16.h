@@ -0,0 +1,32 @@
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// C equivalents of the avr-libc functions, as given in its documentation
+
+inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+    crc ^= a;
+    for (int i = 0; i < 8; ++i)
+        crc = crc & 1 ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    return crc;
+}
+
+inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= crc & 0xff;
+    data ^= data << 4;
+    return ((uint16_t(data) << 8) | (crc >> 8)) ^ uint8_t(data >> 4)
+        ^ (uint16_t(data) << 3);
+}
+
+inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    data ^= crc;
+    for (int i = 0; i < 8; ++i)
+        data = data & 0x80 ? (data << 1) ^ 0x07 : data << 1;
+    return data;
+}
+
+#endif // HOST_UTIL_CRC16_H
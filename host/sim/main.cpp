@@ -0,0 +1,114 @@
+/*
+ * Robot simulator
+ *
+ * Runs the robot code in Robot.ino in a simulated world, for a number of
+ * episodes starting at random poses, and prints the outcome of each episode
+ * followed by a summary.
+ *
+ * Usage: sim [options] [world file]
+ *   -n count    number of episodes (default 16)
+ *   -j jobs     number of episodes to run in parallel (default: number of cores)
+ *   -t seconds  simulated duration of an episode (default 60)
+ *   -s seed     seed of the first episode (default 1)
+ *   -l us       virtual time per pass through loop() (default 200)
+ *   -o prefix   write a trace of every episode to <prefix><episode>.csv
+ *   -v          show the serial output of the robot code
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include "simulation.h"
+
+namespace
+{
+
+void usage()
+{
+    fprintf(stderr, "Usage: sim [-n count] [-j jobs] [-t seconds] [-s seed] "
+        "[-l loop_us] [-o trace_prefix] [-v] [world]\n");
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Simulation::Options options;
+    uint32_t count = 16;
+    uint32_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:t:s:l:o:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': count = strtoul(optarg, nullptr, 0); break;
+            case 'j': jobs = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+            case 't': options.duration = strtod(optarg, nullptr); break;
+            case 's': seed = strtoul(optarg, nullptr, 0); break;
+            case 'l': options.loop_us = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+            case 'o':
+                options.trace_prefix = optarg;
+                options.trace_ms = 50;
+                break;
+            case 'v': options.serial = true; break;
+            default: usage();
+        }
+    }
+    if (optind < argc - 1)
+        usage();
+
+    World world = World::defaultRoom();
+    if (optind < argc)
+    {
+        std::string error;
+        if (!world.load(argv[optind], error))
+        {
+            fprintf(stderr, "sim: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<Simulation::Result> results
+        = Simulation::runEpisodes(world, options, count, jobs, seed);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("episode    seed  start_x  start_y  distance  collisions  contact_s"
+        "  idle_s  min_clear  coverage\n");
+    double sim_time = 0, distance = 0, contact = 0, coverage = 0;
+    uint32_t collisions = 0, collided = 0, failed = 0;
+    for (const Simulation::Result& res: results)
+    {
+        if (!res.ok)
+        {
+            printf("%7u %7u  failed\n", res.episode, res.seed);
+            ++failed;
+            continue;
+        }
+        printf("%7u %7u %8.1f %8.1f %9.1f %11u %10.2f %7.2f %10.1f %9.2f\n",
+            res.episode, res.seed, res.start.x, res.start.y, res.distance,
+            res.collisions, res.contact_time, res.idle_time, res.min_clearance,
+            res.coverage);
+        sim_time += res.sim_time;
+        distance += res.distance;
+        contact += res.contact_time;
+        coverage += res.coverage;
+        collisions += res.collisions;
+        collided += res.collisions > 0;
+    }
+
+    uint32_t ok = results.size() - failed;
+    printf("\n%u episodes (%u failed), %u with collisions, %u collisions in total\n",
+        uint32_t(results.size()), failed, collided, collisions);
+    if (ok)
+        printf("mean distance %.1f cm, mean contact time %.2f s, mean coverage %.2f m²\n",
+            distance / ok, contact / ok, coverage / ok);
+    printf("simulated %.0f s in %.2f s wall clock time (%.0fx real time)\n",
+        sim_time, wall, sim_time / wall);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include <math.h>
+#include "eyes.h"
+#include "robotmodel.h"
+
+namespace
+{
+
+// Smallest and largest ADC value that Eyes::infraredVoltToCm() converts
+const int ir_min_adc = 60;
+const int ir_max_adc = 600;
+
+// Range and beam half width of the ultrasound sensor
+const double us_max_range = 500;
+const double us_beam = 0.13;
+
+} // namespace
+
+RobotModel::RobotModel(const Parameters& params, const Pose& pose, uint32_t seed):
+    _params(params), _pose(pose), _speed{0, 0}, _contact(false),
+    _collisions(0), _distance(0), _rng(seed) {}
+
+void RobotModel::step(double dt, const World& world)
+{
+    for (uint8_t m = 0; m < 2; ++m)
+    {
+        uint16_t pwm;
+        ShieldModel::Drive drive = _shield.motor(m, pwm);
+        double duty = pwm / 4096.0;
+        double target = 0, tau = _params.tau_coast;
+        if (drive == ShieldModel::FORWARD || drive == ShieldModel::BACKWARD)
+        {
+            tau = _params.tau_drive;
+            if (duty > _params.deadband)
+                target = (duty - _params.deadband) / (1 - _params.deadband) * _params.max_speed;
+            if (drive == ShieldModel::BACKWARD)
+                target = -target;
+        }
+        else if (drive == ShieldModel::BRAKED)
+        {
+            tau = _params.tau_brake;
+        }
+        _speed[m] += (target - _speed[m]) * (1 - exp(-dt / tau));
+    }
+
+    double v = (_speed[0] + _speed[1]) / 2;
+    double w = (_speed[1] - _speed[0]) / _params.wheel_base;
+    double heading = _pose.heading + w * dt / 2;
+    Point next = { _pose.x + v * dt * cos(heading), _pose.y + v * dt * sin(heading) };
+    _pose.heading = remainder(_pose.heading + w * dt, 2 * M_PI);
+
+    double clearance = world.clearance(next);
+    bool contact = clearance < _params.radius;
+    if (contact && clearance < world.clearance(Point{_pose.x, _pose.y}))
+    {
+        // Blocked by the wall, the wheels stall
+        _speed[0] = _speed[1] = 0;
+    }
+    else
+    {
+        _distance += fabs(v * dt);
+        _pose.x = next.x;
+        _pose.y = next.y;
+    }
+    if (contact && !_contact)
+        ++_collisions;
+    _contact = contact;
+}
+
+int RobotModel::infraredAdc(uint8_t which, const World& world)
+{
+    double angle = _pose.heading + _params.ir_angles[which];
+    // The sensors are mounted on the edge of the body, and do not see the
+    // wall they are touching
+    Point origin = {
+        _pose.x + _params.radius * cos(angle),
+        _pose.y + _params.radius * sin(angle)
+    };
+    double dist = world.castRay(origin, angle, 1000);
+    std::normal_distribution<double> noise(0, _params.ir_noise);
+    int adc = infraredInverse(dist) + int(lround(noise(_rng)));
+    return adc < 0 ? 0 : (adc > 1023 ? 1023 : adc);
+}
+
+double RobotModel::ultrasoundDistance(const World& world) const
+{
+    Point origin = {
+        _pose.x + _params.radius * cos(_pose.heading),
+        _pose.y + _params.radius * sin(_pose.heading)
+    };
+    double dist = us_max_range;
+    for (int i = -1; i <= 1; ++i)
+        dist = std::min(dist, world.castRay(origin, _pose.heading + i * us_beam, us_max_range));
+    return dist;
+}
+
+int RobotModel::infraredInverse(double dist)
+{
+    // Out of range, the sensor output drops to (almost) nothing
+    if (dist > Eyes::infraredVoltToCm(ir_min_adc))
+        return ir_min_adc / 2;
+    if (dist < Eyes::infraredVoltToCm(ir_max_adc))
+        return ir_max_adc + 20;
+
+    // The curve is decreasing, find the smallest ADC value that gives at
+    // most dist
+    int lo = ir_min_adc, hi = ir_max_adc;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (Eyes::infraredVoltToCm(mid) <= dist)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
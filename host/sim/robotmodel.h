@@ -0,0 +1,100 @@
+#ifndef SIM_ROBOTMODEL_H
+#define SIM_ROBOTMODEL_H
+
+#include <stdint.h>
+#include <random>
+#include "shieldmodel.h"
+#include "world.h"
+
+/**
+ * Model of the robot
+ *
+ * A differential drive robot with a circular body, driven by the first two
+ * DC motor ports of an Adafruit motor shield. The state of the PCA9685 PWM
+ * chip on the shield is decoded from the I2C writes of the robot code, so
+ * whatever Adafruit_DCMotor::run() and setSpeed() (or their queued variants)
+ * do ends up in the wheel speeds. Each wheel approaches the speed set by its
+ * motor with a first order lag, which is much shorter when the motor is
+ * braked than when it is released.
+ *
+ * The infrared sensors and the ultrasound sensor are modelled by casting rays
+ * into the world. The infrared model turns the distance into the ADC value
+ * for which Eyes::infraredVoltToCm() returns that distance, plus some noise.
+ */
+class RobotModel
+{
+public:
+    /// Physical parameters of the robot
+    struct Parameters
+    {
+        /// Radius of the body, in cm
+        double radius = 10;
+        /// Distance between the wheels, in cm
+        double wheel_base = 14;
+        /// Wheel speed at full PWM, in cm/s
+        double max_speed = 60;
+        /// Fraction of full PWM below which a motor does not turn
+        double deadband = 0.05;
+        /// Time constant of a driven motor, in s
+        double tau_drive = 0.15;
+        /// Time constant of a released (coasting) motor, in s
+        double tau_coast = 0.4;
+        /// Time constant of a braked motor, in s
+        double tau_brake = 0.04;
+        /// Standard deviation of the infrared ADC noise, in ADC counts
+        double ir_noise = 3;
+        /// Angles of the infrared sensors (center, left, right) to the heading, in radians
+        double ir_angles[3] = { 0, M_PI/4, -M_PI/4 };
+    };
+
+    /// Create a robot model with parameters \a params at pose \a pose
+    RobotModel(const Parameters& params, const Pose& pose, uint32_t seed);
+
+    /// Return the current pose
+    const Pose& pose() const { return _pose; }
+    /// Return the current speeds of the left and right wheel, in cm/s
+    double speedLeft() const { return _speed[0]; }
+    double speedRight() const { return _speed[1]; }
+    /// Return \c true if the robot is touching a wall
+    bool contact() const { return _contact; }
+    /// Return the number of times the robot ran into a wall
+    uint32_t collisions() const { return _collisions; }
+    /// Return the total distance travelled by the center of the robot, in cm
+    double distance() const { return _distance; }
+
+    /**
+     * Move the robot
+     *
+     * Update the wheel speeds and the pose of the robot for a time step of
+     * \a dt seconds. The robot cannot move into a wall; it stops when it
+     * touches one, but can turn or back away from it.
+     */
+    void step(double dt, const World& world);
+
+    /// Handle the I2C write transaction of \a len bytes in \a data to address \a addr
+    void i2cWrite(uint8_t addr, const uint8_t* data, uint8_t len)
+    {
+        _shield.write(addr, data, len);
+    }
+    /// Return the ADC value of infrared sensor \a which (center, left, right)
+    int infraredAdc(uint8_t which, const World& world);
+    /// Return the distance measured by the ultrasound sensor, in cm
+    double ultrasoundDistance(const World& world) const;
+
+    /// Return the ADC value for which Eyes::infraredVoltToCm() returns \a dist
+    static int infraredInverse(double dist);
+
+private:
+    Parameters _params;
+    Pose _pose;
+    /// Speeds of the left and right wheel
+    double _speed[2];
+    bool _contact;
+    uint32_t _collisions;
+    double _distance;
+    std::mt19937 _rng;
+    /// The motor shield, the left motor is on port 1, the right one on port 2
+    ShieldModel _shield;
+};
+
+#endif // SIM_ROBOTMODEL_H
@@ -0,0 +1,92 @@
+#include "pwmservodriver.h"
+#include "shieldmodel.h"
+
+namespace
+{
+
+// PCA9685 channels of the PWM and input pins of the DC motor ports, see the
+// Adafruit_MotorShield constructor
+const uint8_t motor_pins[4][3] = {
+    { 8, 10, 9 },
+    { 13, 11, 12 },
+    { 2, 4, 3 },
+    { 7, 5, 6 }
+};
+
+// Full on or off bit in the high byte of a count
+const uint16_t full = 0x1000;
+
+} // namespace
+
+ShieldModel::ShieldModel(uint8_t addr): _addr(addr), _on{0}
+{
+    // All channels are fully off after power up
+    for (uint8_t ch = 0; ch < 16; ++ch)
+        _off[ch] = full;
+}
+
+bool ShieldModel::write(uint8_t addr, const uint8_t* data, uint8_t len)
+{
+    if (len == 0 || (addr != _addr && addr != PCA9685_ALLCALL_I2C_ADDR && addr != 0x71))
+        return false;
+
+    // The first byte selects the register, the robot code always enables
+    // auto increment
+    uint8_t reg = data[0];
+    for (uint8_t i = 1; i < len; ++i)
+        _writeRegister(reg++, data[i]);
+    return true;
+}
+
+double ShieldModel::duty(uint8_t ch) const
+{
+    return pwm(ch) / 4096.0;
+}
+
+uint16_t ShieldModel::pwm(uint8_t ch) const
+{
+    if (_off[ch] & full)
+        return 0;
+    if (_on[ch] & full)
+        return 4096;
+    return (_off[ch] - _on[ch]) & 0xfff;
+}
+
+ShieldModel::Drive ShieldModel::motor(uint8_t port, uint16_t& value) const
+{
+    value = pwm(motor_pins[port][0]);
+    bool in1 = pwm(motor_pins[port][1]) >= 2048;
+    bool in2 = pwm(motor_pins[port][2]) >= 2048;
+    if (in1 && in2)
+        return BRAKED;
+    if (in1)
+        return FORWARD;
+    if (in2)
+        return BACKWARD;
+    return RELEASED;
+}
+
+const char* ShieldModel::driveName(Drive drive)
+{
+    static const char* const names[] = { "RELEASE", "FORWARD", "BACKWARD", "BREAK" };
+    return names[drive];
+}
+
+void ShieldModel::_writeRegister(uint8_t reg, uint8_t value)
+{
+    if (reg >= LED0_ON_L && reg < LED0_ON_L + 4*16)
+    {
+        uint8_t ch = (reg - LED0_ON_L) / 4;
+        reg = (reg - LED0_ON_L) % 4;
+        uint16_t* count = (reg < 2 ? _on : _off) + ch;
+        if (reg % 2)
+            *count = (*count & 0xff) | (uint16_t(value & 0x1f) << 8);
+        else
+            *count = (*count & 0x1f00) | value;
+    }
+    else if (reg >= ALLLED_ON_L && reg <= ALLLED_OFF_H)
+    {
+        for (uint8_t ch = 0; ch < 16; ++ch)
+            _writeRegister(LED0_ON_L + 4*ch + reg - ALLLED_ON_L, value);
+    }
+}
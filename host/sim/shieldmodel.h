@@ -0,0 +1,57 @@
+#ifndef SIM_SHIELDMODEL_H
+#define SIM_SHIELDMODEL_H
+
+#include <stdint.h>
+
+/**
+ * Model of the Adafruit motor shield
+ *
+ * Decodes the I2C writes to the PCA9685 PWM chip on the shield into the
+ * state of its channels, and from those the state of the DC motor ports.
+ */
+class ShieldModel
+{
+public:
+    /// State of a DC motor port
+    enum Drive
+    {
+        RELEASED,
+        FORWARD,
+        BACKWARD,
+        BRAKED
+    };
+
+    /// Create a shield at I2C address \a addr, with all channels off
+    ShieldModel(uint8_t addr=0x60);
+
+    /**
+     * Handle an I2C write
+     *
+     * Handle the write transaction of \a len bytes in \a data to address
+     * \a addr. The shield responds to its own address, and to the broadcast
+     * addresses used by MotorShieldGroup.
+     * \return \c true if the shield responded.
+     */
+    bool write(uint8_t addr, const uint8_t* data, uint8_t len);
+    /// Return the duty cycle of channel \a ch, between 0 and 1
+    double duty(uint8_t ch) const;
+    /// Return the 12 bit PWM value of channel \a ch, 4096 when fully on
+    uint16_t pwm(uint8_t ch) const;
+    /**
+     * Return the state of DC motor port \a port (0 to 3), and set \a pwm to
+     * its 12 bit PWM value.
+     */
+    Drive motor(uint8_t port, uint16_t& pwm) const;
+    /// Return the name of drive state \a drive
+    static const char* driveName(Drive drive);
+
+private:
+    uint8_t _addr;
+    /// On and off counts of the channels, including the full on/off bits
+    uint16_t _on[16], _off[16];
+
+    /// Write \a value to register \a reg
+    void _writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif // SIM_SHIELDMODEL_H
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <map>
+#include <unordered_set>
+#include <Arduino.h>
+#include <Wire.h>
+#include "settings.h"
+#include "simulation.h"
+
+// Entry points of Robot.ino
+void setup();
+void loop();
+ISR(TIMER1_COMPA_vect);
+ISR(EE_READY_vect);
+
+namespace
+{
+
+/// Time an EEPROM byte write takes
+const uint64_t eeprom_write_ns = 3400000;
+
+/// State of the episode running in this process
+struct Episode
+{
+    const World* world;
+    const Simulation::Options* options;
+    RobotModel* robot;
+    Simulation::Result* result;
+    FILE* trace;
+    /// Grid cells visited, see Options::coverage_cell
+    std::unordered_set<uint64_t>* visited;
+    uint64_t last_cell;
+
+    /// Current virtual time in ns
+    uint64_t now_ns;
+    /// Time of the next physics step and Timer1 interrupt
+    uint64_t next_physics_ns;
+    uint64_t next_timer1_ns;
+    /// Time of the next EEPROM ready interrupt
+    uint64_t next_eeprom_ns;
+    /// Time of the next trace record
+    uint64_t next_trace_ns;
+
+    /// Start and end time of the current ultrasound echo pulse
+    uint64_t echo_start_ns, echo_end_ns;
+    bool trigger_high;
+};
+
+Episode episode;
+
+/// Return the Timer1 compare interval in ns, or 0 if the interrupt is disabled
+uint64_t timer1Interval()
+{
+    static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    uint16_t prescale = prescalers[TCCR1B & 0x7];
+    if (!(TIMSK1 & (1 << OCIE1A)) || prescale == 0)
+        return 0;
+    // In CTC mode, the counter runs from 0 up to and including OCR1A
+    return (uint64_t(OCR1A) + 1) * prescale * 1000000000ull / F_CPU;
+}
+
+int onAnalogRead(uint8_t pin)
+{
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        if (pin == IR_pins[i])
+            return episode.robot->infraredAdc(i, *episode.world);
+    }
+    return 0;
+}
+
+void writeTrace()
+{
+    const Pose& pose = episode.robot->pose();
+    fprintf(episode.trace, "%.3f,%.2f,%.2f,%.4f,%.2f,%.2f,%d\n",
+        episode.now_ns * 1e-9, pose.x, pose.y, pose.heading,
+        episode.robot->speedLeft(), episode.robot->speedRight(),
+        episode.robot->contact());
+}
+
+void physicsStep()
+{
+    Simulation::Result& res = *episode.result;
+    double dt = episode.options->physics_us * 1e-6;
+
+    episode.robot->step(dt, *episode.world);
+
+    const Pose& pose = episode.robot->pose();
+    double clearance = episode.world->clearance(Point{pose.x, pose.y})
+        - episode.options->robot.radius;
+    res.min_clearance = std::min(res.min_clearance, clearance);
+    if (episode.robot->contact())
+        res.contact_time += dt;
+    double cell = episode.options->coverage_cell;
+    uint32_t cx = uint32_t(int32_t(floor(pose.x / cell)));
+    uint32_t cy = uint32_t(int32_t(floor(pose.y / cell)));
+    uint64_t c = (uint64_t(cx) << 32) | cy;
+    if (c != episode.last_cell)
+    {
+        episode.visited->insert(c);
+        episode.last_cell = c;
+    }
+    if (fabs(episode.robot->speedLeft()) < 0.5 && fabs(episode.robot->speedRight()) < 0.5)
+        res.idle_time += dt;
+}
+
+/// Advance the virtual time to \a end_ns, handling all events on the way
+void advanceTo(uint64_t end_ns)
+{
+    for (;;)
+    {
+        uint64_t timer1 = timer1Interval();
+        if (timer1 == 0)
+            episode.next_timer1_ns = UINT64_MAX;
+        else if (episode.next_timer1_ns == UINT64_MAX)
+            episode.next_timer1_ns = episode.now_ns + timer1;
+
+        // The shim completes EEPROM writes immediately; space the EEPROM
+        // ready interrupts by the write time instead
+        if (!(EECR & (1 << EERIE)))
+            episode.next_eeprom_ns = UINT64_MAX;
+        else if (episode.next_eeprom_ns == UINT64_MAX)
+            episode.next_eeprom_ns = episode.now_ns;
+
+        uint64_t next = std::min({ episode.next_physics_ns, episode.next_timer1_ns,
+            episode.next_eeprom_ns });
+        if (next > end_ns)
+            break;
+
+        episode.now_ns = next;
+        hostSetMicros(next / 1000);
+        if (next == episode.next_physics_ns)
+        {
+            physicsStep();
+            episode.next_physics_ns += episode.options->physics_us * 1000ull;
+        }
+        if (next == episode.next_timer1_ns)
+        {
+            TIMER1_COMPA_vect();
+            episode.next_timer1_ns += timer1;
+        }
+        if (next == episode.next_eeprom_ns)
+        {
+            EE_READY_vect();
+            episode.next_eeprom_ns += eeprom_write_ns;
+        }
+        if (episode.trace && next >= episode.next_trace_ns)
+        {
+            writeTrace();
+            episode.next_trace_ns += episode.options->trace_ms * 1000000ull;
+        }
+    }
+
+    episode.now_ns = end_ns;
+    hostSetMicros(end_ns / 1000);
+}
+
+void onDelay(uint32_t us)
+{
+    advanceTo(episode.now_ns + us * 1000ull);
+}
+
+void onI2CWrite(uint8_t addr, const uint8_t* data, uint8_t len)
+{
+    episode.robot->i2cWrite(addr, data, len);
+}
+
+void onPinWrite(uint8_t pin, uint8_t val)
+{
+    if (pin != US_trigger_pin)
+        return;
+
+    // The sensor sends its burst on the falling edge of the trigger pulse,
+    // and raises the echo pin for the round trip time of the sound
+    if (episode.trigger_high && val == LOW)
+    {
+        double dist = episode.robot->ultrasoundDistance(*episode.world);
+        episode.echo_start_ns = episode.now_ns + 200000;
+        episode.echo_end_ns = episode.echo_start_ns + uint64_t(dist / 0.034 * 2 * 1000);
+    }
+    episode.trigger_high = val == HIGH;
+}
+
+int onPinRead(uint8_t pin)
+{
+    if (pin == US_echo_pin)
+        return episode.now_ns >= episode.echo_start_ns
+            && episode.now_ns < episode.echo_end_ns ? HIGH : LOW;
+    return LOW;
+}
+
+} // namespace
+
+namespace Simulation
+{
+
+Result runEpisode(const World& world, const Options& options, uint32_t nr,
+    uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    Pose start = world.randomPose(options.robot.radius, rng);
+    RobotModel robot(options.robot, start, rng());
+
+    Result res = Result();
+    res.episode = nr;
+    res.seed = seed;
+    res.start = start;
+    res.min_clearance = HUGE_VAL;
+    std::unordered_set<uint64_t> visited;
+
+    episode.world = &world;
+    episode.options = &options;
+    episode.robot = &robot;
+    episode.result = &res;
+    episode.trace = nullptr;
+    episode.visited = &visited;
+    episode.last_cell = UINT64_MAX;
+    episode.now_ns = 0;
+    episode.next_physics_ns = options.physics_us * 1000ull;
+    episode.next_timer1_ns = UINT64_MAX;
+    episode.next_eeprom_ns = UINT64_MAX;
+    episode.next_trace_ns = 0;
+    episode.echo_start_ns = episode.echo_end_ns = 0;
+    episode.trigger_high = false;
+
+    if (options.trace_ms)
+    {
+        std::string path = options.trace_prefix + std::to_string(nr) + ".csv";
+        episode.trace = fopen(path.c_str(), "w");
+        if (episode.trace)
+            fprintf(episode.trace, "t,x,y,heading,speed_left,speed_right,contact\n");
+    }
+
+    hostUseVirtualClock(onDelay);
+    hostSetPinHandlers(onPinWrite, onPinRead);
+    hostSetAnalogHandler(onAnalogRead);
+    Wire.hostSetDevice(onI2CWrite, nullptr);
+    Serial.hostMute(!options.serial);
+
+    uint64_t end_ns = uint64_t(options.duration * 1e9);
+    setup();
+    while (episode.now_ns < end_ns)
+    {
+        loop();
+        advanceTo(episode.now_ns + options.loop_us * 1000ull);
+    }
+
+    if (episode.trace)
+        fclose(episode.trace);
+
+    res.end = robot.pose();
+    res.distance = robot.distance();
+    res.collisions = robot.collisions();
+    res.coverage = visited.size() * options.coverage_cell * options.coverage_cell * 1e-4;
+    res.sim_time = episode.now_ns * 1e-9;
+    res.ok = true;
+    return res;
+}
+
+std::vector<Result> runEpisodes(const World& world, const Options& options,
+    uint32_t count, uint32_t jobs, uint32_t seed)
+{
+    std::vector<Task> tasks(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        tasks[i].world = &world;
+        tasks[i].seed = seed + i;
+    }
+    return runEpisodes(tasks, options, jobs);
+}
+
+std::vector<Result> runEpisodes(const std::vector<Task>& tasks, const Options& options,
+    uint32_t jobs)
+{
+    uint32_t count = tasks.size();
+    std::vector<Result> results(count);
+    // Running children, with the task they run and the pipe to read the result from
+    std::map<pid_t, std::pair<uint32_t, int> > running;
+
+    fflush(stdout);
+    uint32_t next = 0;
+    while (next < count || !running.empty())
+    {
+        if (next < count && running.size() < jobs)
+        {
+            int fds[2];
+            if (pipe(fds) == 0)
+            {
+                pid_t pid = fork();
+                if (pid == 0)
+                {
+                    close(fds[0]);
+                    const Task& task = tasks[next];
+                    if (task.prepare)
+                        task.prepare();
+                    Result res = runEpisode(*task.world, options, next, task.seed);
+                    fflush(stdout);
+                    // A result is smaller than PIPE_BUF, so it is written at once
+                    ssize_t n = write(fds[1], &res, sizeof(res));
+                    _exit(n == sizeof(res) ? 0 : 1);
+                }
+                close(fds[1]);
+                if (pid > 0)
+                {
+                    running[pid] = std::make_pair(next++, fds[0]);
+                    continue;
+                }
+                close(fds[0]);
+            }
+            if (running.empty())
+            {
+                perror("sim: unable to start episode");
+                results.resize(next);
+                return results;
+            }
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        std::map<pid_t, std::pair<uint32_t, int> >::iterator it = running.find(pid);
+        if (it == running.end())
+            continue;
+
+        uint32_t nr = it->second.first;
+        Result& res = results[nr];
+        if (read(it->second.second, &res, sizeof(res)) != sizeof(res))
+        {
+            res = Result();
+            res.episode = nr;
+            res.seed = tasks[nr].seed;
+        }
+        close(it->second.second);
+        running.erase(it);
+    }
+    return results;
+}
+
+} // namespace Simulation
@@ -0,0 +1,117 @@
+#ifndef SIM_SIMULATION_H
+#define SIM_SIMULATION_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "robotmodel.h"
+#include "world.h"
+
+/**
+ * Simulation of robot runs
+ *
+ * An episode runs the unmodified setup() and loop() of Robot.ino against a
+ * RobotModel in a World, on a virtual clock. Time advances by a fixed amount
+ * per pass through loop() and through delay(); while it advances, the Timer1
+ * compare interrupt handler is called at the interval programmed into the
+ * timer registers, and the physics are stepped at a fixed rate. The Timer2
+ * interrupt of the synthesizer is not simulated, it does not influence the
+ * driving.
+ *
+ * Since the robot code keeps its state in globals, every episode runs in a
+ * forked child process; this also makes it possible to run episodes in
+ * parallel.
+ */
+namespace Simulation
+{
+
+/// Settings of a simulation run
+struct Options
+{
+    /// Simulated duration of an episode, in s
+    double duration = 60;
+    /// Virtual time taken by a single pass through loop(), in us
+    uint32_t loop_us = 200;
+    /// Physics time step, in us
+    uint32_t physics_us = 1000;
+    /// Interval between trace records, in ms; 0 for no trace
+    uint32_t trace_ms = 0;
+    /// Prefix of the trace files, the episode number and .csv are appended
+    std::string trace_prefix = "trace";
+    /// Whether to pass the Serial output of the robot code to standard output
+    bool serial = false;
+    /// Size of the grid cells counted for the area covered, in cm
+    double coverage_cell = 10;
+    /// Physical parameters of the robot
+    RobotModel::Parameters robot;
+};
+
+/// Outcome of a single episode
+struct Result
+{
+    /// Episode number and random seed
+    uint32_t episode, seed;
+    /// Start and end pose
+    Pose start, end;
+    /// Distance travelled, in cm
+    double distance;
+    /// Number of times the robot ran into a wall
+    uint32_t collisions;
+    /// Time spent touching a wall, in s
+    double contact_time;
+    /// Time spent standing still, in s
+    double idle_time;
+    /// Smallest distance between the body of the robot and a wall, in cm
+    double min_clearance;
+    /// Area of the grid cells visited by the center of the robot, in m²
+    double coverage;
+    /// Simulated time, in s
+    double sim_time;
+    /// Whether the episode ran to completion
+    bool ok;
+};
+
+/// An episode to run with runEpisodes()
+struct Task
+{
+    /// The world to run in
+    const World* world;
+    /// Seed of the starting pose and the sensor noise
+    uint32_t seed;
+    /// Function called in the child process before the episode runs, or empty
+    std::function<void()> prepare;
+};
+
+/**
+ * Run a single episode
+ *
+ * Run episode \a episode in the current process, starting at a random pose
+ * chosen with seed \a seed. This can only be done once per process.
+ */
+Result runEpisode(const World& world, const Options& options, uint32_t episode,
+    uint32_t seed);
+
+/**
+ * Run episodes in parallel
+ *
+ * Run \a count episodes, each in its own child process, with at most \a jobs
+ * running at the same time. Episode \c i uses seed \a seed + \c i.
+ * \return The results, in episode order.
+ */
+std::vector<Result> runEpisodes(const World& world, const Options& options,
+    uint32_t count, uint32_t jobs, uint32_t seed);
+/**
+ * Run tasks in parallel
+ *
+ * Run an episode for every task in \a tasks, each in its own child process,
+ * with at most \a jobs running at the same time. The prepare function of a
+ * task can change the robot code's globals without affecting other tasks.
+ * \return The results, in task order. Episode numbers are task indexes.
+ */
+std::vector<Result> runEpisodes(const std::vector<Task>& tasks, const Options& options,
+    uint32_t jobs);
+
+} // namespace Simulation
+
+#endif // SIM_SIMULATION_H
@@ -0,0 +1,159 @@
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include "world.h"
+
+namespace
+{
+
+inline double cross(double ax, double ay, double bx, double by)
+{
+    return ax*by - ay*bx;
+}
+
+/// Distance from \a p to the segment from \a a to \a b
+double segmentDistance(const Point& p, const Point& a, const Point& b)
+{
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double len2 = dx*dx + dy*dy;
+    double t = len2 > 0 ? ((p.x-a.x)*dx + (p.y-a.y)*dy) / len2 : 0;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    return hypot(p.x - (a.x + t*dx), p.y - (a.y + t*dy));
+}
+
+} // namespace
+
+bool World::load(const std::string& path, std::string& error)
+{
+    std::ifstream is(path.c_str());
+    if (!is)
+    {
+        error = "unable to open " + path;
+        return false;
+    }
+
+    _polygons.clear();
+    std::string line;
+    for (int line_nr = 1; std::getline(is, line); ++line_nr)
+    {
+        std::istringstream ls(line);
+        std::string keyword;
+        if (!(ls >> keyword) || keyword[0] == '#')
+            continue;
+
+        std::vector<Point> corners;
+        Point p;
+        while (ls >> p.x >> p.y)
+            corners.push_back(p);
+        if (keyword != "polygon" || !ls.eof() || corners.size() < 3)
+        {
+            error = path + ":" + std::to_string(line_nr) + ": invalid polygon";
+            return false;
+        }
+        addPolygon(corners);
+    }
+
+    if (_polygons.empty())
+    {
+        error = path + ": no polygons";
+        return false;
+    }
+    return true;
+}
+
+World World::defaultRoom()
+{
+    World world;
+    world.addPolygon({ {0, 0}, {400, 0}, {400, 300}, {0, 300} });
+    // A cupboard against the wall, a table leg and a box in a corner
+    world.addPolygon({ {150, 240}, {250, 240}, {250, 300}, {150, 300} });
+    world.addPolygon({ {95, 95}, {105, 95}, {105, 105}, {95, 105} });
+    world.addPolygon({ {320, 0}, {400, 80}, {320, 80} });
+    return world;
+}
+
+double World::castRay(const Point& origin, double angle, double max_range) const
+{
+    double dx = cos(angle), dy = sin(angle);
+    double best = max_range;
+    for (const std::vector<Point>& poly: _polygons)
+    {
+        for (size_t i = 0; i < poly.size(); ++i)
+        {
+            const Point& a = poly[i];
+            const Point& b = poly[(i+1) % poly.size()];
+            double ex = b.x - a.x, ey = b.y - a.y;
+            double denom = cross(dx, dy, ex, ey);
+            if (denom == 0)
+                continue;
+            double wx = a.x - origin.x, wy = a.y - origin.y;
+            double t = cross(wx, wy, ex, ey) / denom;
+            double u = cross(wx, wy, dx, dy) / denom;
+            if (t >= 0 && t < best && u >= 0 && u <= 1)
+                best = t;
+        }
+    }
+    return best;
+}
+
+double World::clearance(const Point& p) const
+{
+    double best = HUGE_VAL;
+    for (const std::vector<Point>& poly: _polygons)
+    {
+        for (size_t i = 0; i < poly.size(); ++i)
+            best = std::min(best, segmentDistance(p, poly[i], poly[(i+1) % poly.size()]));
+    }
+    return best;
+}
+
+bool World::free(const Point& p, double radius) const
+{
+    if (_polygons.empty() || !_inside(_polygons[0], p))
+        return false;
+    for (size_t i = 1; i < _polygons.size(); ++i)
+    {
+        if (_inside(_polygons[i], p))
+            return false;
+    }
+    return clearance(p) >= radius;
+}
+
+Pose World::randomPose(double radius, std::mt19937& rng) const
+{
+    const std::vector<Point>& outer = _polygons[0];
+    Point lo = outer[0], hi = outer[0];
+    for (const Point& p: outer)
+    {
+        lo.x = std::min(lo.x, p.x);
+        lo.y = std::min(lo.y, p.y);
+        hi.x = std::max(hi.x, p.x);
+        hi.y = std::max(hi.y, p.y);
+    }
+
+    std::uniform_real_distribution<double> xs(lo.x, hi.x), ys(lo.y, hi.y),
+        headings(-M_PI, M_PI);
+    Pose pose;
+    do
+    {
+        pose.x = xs(rng);
+        pose.y = ys(rng);
+    } while (!free(Point{pose.x, pose.y}, radius));
+    pose.heading = headings(rng);
+    return pose;
+}
+
+bool World::_inside(const std::vector<Point>& poly, const Point& p)
+{
+    // Count crossings of a ray in the positive x direction
+    bool inside = false;
+    for (size_t i = 0, j = poly.size()-1; i < poly.size(); j = i++)
+    {
+        const Point& a = poly[i];
+        const Point& b = poly[j];
+        if ((a.y > p.y) != (b.y > p.y)
+                && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+            inside = !inside;
+    }
+    return inside;
+}
@@ -0,0 +1,79 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+/// A point or vector in the plane, in centimeters
+struct Point
+{
+    double x, y;
+};
+
+/// Position and heading (radians, counterclockwise from the x axis) of the robot
+struct Pose
+{
+    double x, y, heading;
+};
+
+/**
+ * Two dimensional world of polygons
+ *
+ * The world consists of closed polygons, the first of which is the outer wall
+ * of the arena; the others are obstacles within it. All coordinates are in
+ * centimeters.
+ */
+class World
+{
+public:
+    /**
+     * Load a world
+     *
+     * Load the polygons from file \a path. Every line of the file starting
+     * with \c polygon describes a polygon by the x and y coordinates of its
+     * corners; empty lines and lines starting with \c # are ignored.
+     * \param path  The file to read.
+     * \param error Set to a description of the problem when loading fails.
+     * \return \c true on success, \c false on failure.
+     */
+    bool load(const std::string& path, std::string& error);
+    /// Return a 4 x 3 m room with a few obstacles
+    static World defaultRoom();
+
+    /// Add the closed polygon with corners \a corners
+    void addPolygon(const std::vector<Point>& corners)
+    {
+        _polygons.push_back(corners);
+    }
+    /// Return the number of polygons
+    size_t size() const { return _polygons.size(); }
+
+    /**
+     * Cast a ray
+     *
+     * Return the distance from \a origin to the nearest wall in direction
+     * \a angle, or \a max_range if there is no wall within that distance.
+     */
+    double castRay(const Point& origin, double angle, double max_range) const;
+    /// Return the distance from \a p to the nearest wall
+    double clearance(const Point& p) const;
+    /// Return \c true if a circle of radius \a radius around \a p fits in the free space
+    bool free(const Point& p, double radius) const;
+    /**
+     * Pick a random pose
+     *
+     * Return a random pose of a robot with radius \a radius, in which it
+     * does not touch any wall.
+     */
+    Pose randomPose(double radius, std::mt19937& rng) const;
+
+private:
+    /// The polygons, the first is the outer wall
+    std::vector< std::vector<Point> > _polygons;
+
+    /// Return \c true if \a p lies inside polygon \a poly
+    static bool _inside(const std::vector<Point>& poly, const Point& p);
+};
+
+#endif // SIM_WORLD_H
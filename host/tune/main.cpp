@@ -0,0 +1,336 @@
+/*
+ * Autotuner of the navigation parameters
+ *
+ * Searches the parameters in navsettings.h for the best driving of the
+ * robot code in Robot.ino in a set of simulated rooms, and writes a new
+ * navsettings.h with the best parameters found. Every candidate is run for
+ * the same episodes in every room, starting at the same poses. Candidates
+ * are scored by their mean speed, plus coverage_weight (cm/s per m²) times
+ * the mean area covered; every collision costs collision_penalty, so that
+ * any candidate without collisions beats every one with collisions.
+ *
+ * The search is a parallel random search: the first generation samples
+ * the whole parameter space, later generations mostly sample around the
+ * best candidate so far, with a step size that shrinks when a generation
+ * brings no improvement. The episodes of a generation run in parallel on
+ * all cores. Finally, the best candidate and the current defaults are run
+ * on new starting poses, to check that the gain is not an artifact of the
+ * poses used in the search. If the best candidate scores below the defaults
+ * there, no settings are written, and tune exits with status 2.
+ *
+ * Usage: tune [options] [world files]
+ *   -g count    number of generations (default 12)
+ *   -p count    candidates per generation (default 24)
+ *   -e count    episodes per room and candidate (default 4)
+ *   -t seconds  simulated duration of an episode (default 30)
+ *   -j jobs     number of episodes to run in parallel (default: number of cores)
+ *   -s seed     seed of the search and of the starting poses (default 1)
+ *   -w weight   coverage weight, in cm/s per m² (default 5)
+ *   -o path     write the settings header to path (default: standard output)
+ *
+ * The default room of the simulator is always one of the rooms.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+#include "navsettings.h"
+#include "../sim/simulation.h"
+
+namespace
+{
+
+const double collision_penalty = 1000;
+
+/// A tunable parameter, with its documentation in navsettings.h and its range
+struct Parameter
+{
+    const char* name;
+    const char* doc;
+    int* value;
+    int lo, hi;
+};
+
+const Parameter parameters[] = {
+    { "min_cruise_dist", "Minimum distance from walls for full speed cruising, in cm",
+        &min_cruise_dist, 30, 150 },
+    { "min_dist_soft", "Distance to a wall below which a cruising robot stops, in cm",
+        &min_dist_soft, 5, 40 },
+    { "min_dist_hard", "Distance to a wall below which the robot never drives straight on, in cm",
+        &min_dist_hard, 5, 40 },
+    { "cruise_speed", "Speed at full speed cruising",
+        &cruise_speed, 100, 255 },
+    { "approach_speed", "Speed at min_dist_hard, rising linearly to cruise_speed at min_cruise_dist",
+        &approach_speed, 20, 255 },
+    { "turn_speed", "Speed of the outer side when turning away from a wall",
+        &turn_speed, 0, 255 },
+    { "turn_sharpness", "Turning speed when turning away from a wall, 255 turns in place",
+        &turn_sharpness, 64, 255 },
+    { "field_steering", "Steer around obstacles while moving (1), or only stop and turn at walls (0)",
+        &field_steering, 0, 1 },
+    { "field_range", "Distance within which obstacles push the robot away when steering, in cm",
+        &field_range, 20, 150 },
+    { "field_gain", "Turning speed per unit of sideways push, times field_range",
+        &field_gain, 16, 512 }
+};
+const size_t nr_parameters = sizeof(parameters) / sizeof(parameters[0]);
+
+typedef std::vector<int> Candidate;
+
+/// Outcome of the episodes of a candidate
+struct Score
+{
+    double value;
+    /// Mean speed in cm/s, and mean area covered in m²
+    double speed, coverage;
+    uint32_t collisions;
+};
+
+struct Settings
+{
+    uint32_t generations = 12;
+    uint32_t population = 24;
+    uint32_t episodes = 4;
+    uint32_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t seed = 1;
+    double coverage_weight = 5;
+    Simulation::Options options;
+};
+
+Candidate defaults()
+{
+    Candidate c(nr_parameters);
+    for (size_t i = 0; i < nr_parameters; ++i)
+        c[i] = *parameters[i].value;
+    return c;
+}
+
+void apply(const Candidate& c)
+{
+    for (size_t i = 0; i < nr_parameters; ++i)
+        *parameters[i].value = c[i];
+}
+
+/// Return \c true if the robot code can run with the parameters in \a c
+bool valid(const Candidate& c)
+{
+    // Indexes in parameters
+    enum { CRUISE_DIST, SOFT, HARD, CRUISE_SPEED, APPROACH_SPEED };
+    return c[HARD] + 10 <= c[CRUISE_DIST] && c[SOFT] + 10 <= c[CRUISE_DIST]
+        && c[APPROACH_SPEED] <= c[CRUISE_SPEED];
+}
+
+/**
+ * Return a random valid candidate: uniform over the ranges if \a sigma is
+ * zero, else normally distributed around \a center with standard deviation
+ * \a sigma times the range of each parameter.
+ */
+Candidate sample(const Candidate& center, double sigma, std::mt19937& rng)
+{
+    Candidate c(nr_parameters);
+    do
+    {
+        for (size_t i = 0; i < nr_parameters; ++i)
+        {
+            const Parameter& p = parameters[i];
+            double v;
+            if (sigma == 0)
+                v = std::uniform_real_distribution<double>(p.lo, p.hi)(rng);
+            else
+                v = std::normal_distribution<double>(center[i], sigma * (p.hi - p.lo))(rng);
+            c[i] = std::min(p.hi, std::max(p.lo, int(lround(v))));
+        }
+    } while (!valid(c));
+    return c;
+}
+
+/// Run every candidate in \a candidates in every world, and return their scores
+std::vector<Score> evaluate(const std::vector<Candidate>& candidates,
+    const std::vector<World>& worlds, const Settings& settings, uint32_t seed)
+{
+    std::vector<Simulation::Task> tasks;
+    for (const Candidate& c: candidates)
+    {
+        for (const World& world: worlds)
+        {
+            for (uint32_t e = 0; e < settings.episodes; ++e)
+            {
+                Simulation::Task task;
+                task.world = &world;
+                task.seed = seed + e;
+                task.prepare = [&c]() { apply(c); };
+                tasks.push_back(task);
+            }
+        }
+    }
+
+    std::vector<Simulation::Result> results
+        = Simulation::runEpisodes(tasks, settings.options, settings.jobs);
+    uint32_t per_candidate = worlds.size() * settings.episodes;
+    std::vector<Score> scores(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        double distance = 0, time = 0, coverage = 0;
+        uint32_t collisions = 0, failed = 0;
+        for (uint32_t j = i * per_candidate; j < (i + 1) * per_candidate; ++j)
+        {
+            const Simulation::Result& res = results[j];
+            if (!res.ok)
+            {
+                ++failed;
+                continue;
+            }
+            distance += res.distance;
+            time += res.sim_time;
+            coverage += res.coverage;
+            collisions += res.collisions;
+        }
+
+        Score& s = scores[i];
+        s.speed = time > 0 ? distance / time : 0;
+        s.coverage = coverage / per_candidate;
+        s.collisions = collisions;
+        // A crashing episode is as bad as a collision
+        s.value = s.speed + settings.coverage_weight * s.coverage
+            - collision_penalty * (collisions + failed);
+    }
+    return scores;
+}
+
+void printScore(const char* what, const Score& s)
+{
+    fprintf(stderr, "%s: score %.2f (speed %.1f cm/s, coverage %.2f m², %u collisions)\n",
+        what, s.value, s.speed, s.coverage, s.collisions);
+}
+
+void writeHeader(FILE* f, const Candidate& c, const Score& s, const Settings& settings,
+    size_t nr_worlds)
+{
+    fprintf(f,
+        "#ifndef NAVSETTINGS_H\n"
+        "#define NAVSETTINGS_H\n"
+        "\n"
+        "/*\n"
+        " * Navigation parameters of Robot.ino\n"
+        " *\n"
+        " * This file can be regenerated with tuned values by host/tune, which\n"
+        " * searches the parameters in simulated rooms. The parameters are variables\n"
+        " * defined in Robot.ino, so that they can also be changed over the serial\n"
+        " * port (see tunables.h); the values here are their defaults.\n"
+        " *\n"
+        " * Tuned in %zu rooms with %u episodes each: mean speed %.1f cm/s,\n"
+        " * coverage %.2f m², %u collisions.\n"
+        " */\n"
+        "\n"
+        "#define NAV_PARAM(name, value) extern int name; const int name##_default = value\n",
+        nr_worlds, settings.episodes, s.speed, s.coverage, s.collisions);
+    for (size_t i = 0; i < nr_parameters; ++i)
+        fprintf(f, "\n/// %s\nNAV_PARAM(%s, %d);", parameters[i].doc, parameters[i].name, c[i]);
+    fprintf(f, "\n\n#endif // NAVSETTINGS_H\n");
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: tune [-g generations] [-p population] [-e episodes] "
+        "[-t seconds] [-j jobs] [-s seed] [-w weight] [-o path] [world...]\n");
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    settings.options.duration = 30;
+    const char* out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:p:e:t:j:s:w:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'g': settings.generations = strtoul(optarg, nullptr, 0); break;
+            case 'p': settings.population = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+            case 'e': settings.episodes = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+            case 't': settings.options.duration = strtod(optarg, nullptr); break;
+            case 'j': settings.jobs = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+            case 's': settings.seed = strtoul(optarg, nullptr, 0); break;
+            case 'w': settings.coverage_weight = strtod(optarg, nullptr); break;
+            case 'o': out_path = optarg; break;
+            default: usage();
+        }
+    }
+
+    std::vector<World> worlds(1, World::defaultRoom());
+    for (int i = optind; i < argc; ++i)
+    {
+        World world;
+        std::string error;
+        if (!world.load(argv[i], error))
+        {
+            fprintf(stderr, "tune: %s\n", error.c_str());
+            return 1;
+        }
+        worlds.push_back(world);
+    }
+
+    std::mt19937 rng(settings.seed);
+    Candidate start = defaults();
+    Candidate best = start;
+    Score best_score = evaluate({ best }, worlds, settings, settings.seed)[0];
+    printScore("defaults", best_score);
+
+    double sigma = 0.15;
+    for (uint32_t g = 0; g < settings.generations; ++g)
+    {
+        // Keep a quarter of every generation exploring the whole space
+        std::vector<Candidate> candidates;
+        for (uint32_t i = 0; i < settings.population; ++i)
+        {
+            bool explore = g == 0 || i % 4 == 3;
+            candidates.push_back(sample(best, explore ? 0 : sigma, rng));
+        }
+
+        std::vector<Score> scores = evaluate(candidates, worlds, settings, settings.seed);
+        size_t top = std::max_element(scores.begin(), scores.end(),
+            [](const Score& a, const Score& b) { return a.value < b.value; }) - scores.begin();
+        if (scores[top].value > best_score.value)
+        {
+            best = candidates[top];
+            best_score = scores[top];
+        }
+        else if (g > 0)
+        {
+            sigma = std::max(0.02, sigma / 2);
+        }
+        printScore(("generation " + std::to_string(g + 1)).c_str(), best_score);
+    }
+
+    // Check on starting poses not used in the search
+    uint32_t check_seed = settings.seed + 1000000;
+    std::vector<Score> check = evaluate({ start, best }, worlds, settings, check_seed);
+    printScore("defaults on new poses", check[0]);
+    printScore("tuned on new poses", check[1]);
+    if (check[1].value < check[0].value)
+    {
+        fprintf(stderr, "tune: the tuned parameters score below the defaults on new poses, "
+            "not writing them\n");
+        return 2;
+    }
+
+    FILE* f = out_path ? fopen(out_path, "w") : stdout;
+    if (!f)
+    {
+        perror(out_path);
+        return 1;
+    }
+    writeHeader(f, best, check[1], settings, worlds.size());
+    if (out_path)
+        fclose(f);
+    return 0;
+}
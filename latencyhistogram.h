@@ -0,0 +1,52 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <Arduino.h>
+
+/**
+ * Histogram of latencies
+ *
+ * Class LatencyHistogram counts latencies in bins that double in width, so
+ * that a few counters cover both sub-millisecond and long latencies. With
+ * the time unit \f$u\f$ = 1024 µs, bin 0 counts latencies below \f$u\f$,
+ * bin \f$i\f$ latencies from \f$2^{i-1}u\f$ up to \f$2^i u\f$, and the last
+ * bin all latencies of at least \f$2^{nr\_bins-2}u\f$. Counts saturate at
+ * their maximum instead of wrapping around.
+ */
+class LatencyHistogram
+{
+public:
+    /// Number of bins
+    static const uint8_t nr_bins = 8;
+
+    /// Constructor
+    LatencyHistogram(): _counts{0} {}
+
+    /// Count a latency of \a us microseconds
+    void add(uint32_t us)
+    {
+        uint32_t units = us >> 10;
+        uint8_t bin = 0;
+        while (units && bin < nr_bins - 1)
+        {
+            units >>= 1;
+            ++bin;
+        }
+        if (_counts[bin] < 0x7fff)
+            ++_counts[bin];
+    }
+    /// Return the counts of all bins
+    const int16_t* counts() const { return _counts; }
+    /// Reset all counts to zero
+    void clear()
+    {
+        for (uint8_t i = 0; i < nr_bins; ++i)
+            _counts[i] = 0;
+    }
+
+private:
+    /// Count of each bin, kept signed so that they can be sent as telemetry fields
+    int16_t _counts[nr_bins];
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -22,6 +22,7 @@
 #endif
 #include <Wire.h>
 #include "motorshield.h"
+#include "hal.h"
 
 #if defined(ARDUINO_SAM_DUE)
  #define WIRE Wire1
@@ -50,16 +51,7 @@ void Adafruit_MotorShield::begin(uint16_t freq)
     _pwm.begin();
     _freq = freq;
     _pwm.setPWMFreq(_freq);  // This is the maximum PWM frequency
-    for (uint8_t i=0; i<16; i++)
-        _pwm.setPWM(i, 0, 0);
-}
-
-void Adafruit_MotorShield::setPWM(uint8_t pin, uint16_t value)
-{
-    if (value > 4095)
-        _pwm.setPWM(pin, 4096, 0);
-    else
-        _pwm.setPWM(pin, 0, value);
+    allOff();
 }
 
 Adafruit_StepperMotor *Adafruit_MotorShield::getStepper(uint16_t steps,
@@ -78,30 +70,62 @@ Adafruit_StepperMotor *Adafruit_MotorShield::getStepper(uint16_t steps,
                MOTORS
 ******************************************/
 
+// The PCA9685 updates its outputs on the I2C stop condition, so when both
+// input pins are written in one transaction, there is no intermediate 'break'
+// state to avoid.
+
 void Adafruit_DCMotor::run(MotorDirection cmd)
+{
+    if (queueRun(cmd))
+        flush();
+}
+
+void Adafruit_DCMotor::setSpeed(uint8_t speed)
+{
+    queueSpeed(speed);
+    flush();
+}
+
+bool Adafruit_DCMotor::queueRun(MotorDirection cmd)
 {
     switch (cmd)
     {
         case FORWARD:
-            _MC->setPin(_IN2_pin, LOW);  // take low first to avoid 'break'
-            _MC->setPin(_IN1_pin, HIGH);
-            break;
+            _MC->queuePin(_IN2_pin, LOW);
+            _MC->queuePin(_IN1_pin, HIGH);
+            return true;
         case BACKWARD:
-            _MC->setPin(_IN1_pin, LOW);  // take low first to avoid 'break'
-            _MC->setPin(_IN2_pin, HIGH);
-            break;
+            _MC->queuePin(_IN1_pin, LOW);
+            _MC->queuePin(_IN2_pin, HIGH);
+            return true;
+        case BREAK:
+            // Short brake: both motor terminals are shorted through the
+            // low side of the bridge
+            _MC->queuePin(_IN1_pin, HIGH);
+            _MC->queuePin(_IN2_pin, HIGH);
+            return true;
         case RELEASE:
-            _MC->setPin(_IN1_pin, LOW);
-            _MC->setPin(_IN2_pin, LOW);
-            break;
+            _MC->queuePin(_IN1_pin, LOW);
+            _MC->queuePin(_IN2_pin, LOW);
+            return true;
         default:
-            /* nothing */ ;
+            return false;
     }
 }
 
-void Adafruit_DCMotor::setSpeed(uint8_t speed)
+void Adafruit_DCMotor::queueSpeed(uint8_t speed)
+{
+    _MC->queuePWM(_PWM_pin, speed*16);
+}
+
+void Adafruit_DCMotor::queueSpeed12(uint16_t speed)
 {
-    _MC->setPWM(_PWM_pin, speed*16);
+    _MC->queuePWM(_PWM_pin, speed);
+}
+
+void Adafruit_DCMotor::flush()
+{
+    _MC->flush();
 }
 
 /******************************************
@@ -144,6 +168,13 @@ void Adafruit_StepperMotor::step(uint16_t steps, MotorDirection dir,
 }
 
 uint8_t Adafruit_StepperMotor::onestep(MotorDirection dir, StepStyle style)
+{
+    uint8_t res = queueStep(dir, style);
+    _MC->flush();
+    return res;
+}
+
+uint8_t Adafruit_StepperMotor::queueStep(MotorDirection dir, StepStyle style)
 {
 #if (MICROSTEPS == 8)
     static const uint8_t microstepcurve[] = {0, 50, 98, 142, 180, 212, 236, 250, 255};
@@ -234,8 +265,8 @@ uint8_t Adafruit_StepperMotor::onestep(MotorDirection dir, StepStyle style)
     _currentstep += MICROSTEPS*4;
     _currentstep %= MICROSTEPS*4;
 
-    _MC->setPWM(_PWM_A_pin, ocra*16);
-    _MC->setPWM(_PWM_B_pin, ocrb*16);
+    _MC->queuePWM(_PWM_A_pin, ocra*16);
+    _MC->queuePWM(_PWM_B_pin, ocrb*16);
 
     // release all
     uint8_t latch_state = 0; // all motor pins to 0
@@ -285,10 +316,10 @@ uint8_t Adafruit_StepperMotor::onestep(MotorDirection dir, StepStyle style)
   Serial.print("Latch: 0x"); Serial.println(latch_state, HEX);
 #endif
 
-    _MC->setPin(_IN2_A_pin, (latch_state & 0x1) ? HIGH : LOW);
-    _MC->setPin(_IN1_B_pin, (latch_state & 0x2) ? HIGH : LOW);
-    _MC->setPin(_IN1_A_pin, (latch_state & 0x4) ? HIGH : LOW);
-    _MC->setPin(_IN2_B_pin, (latch_state & 0x8) ? HIGH : LOW);
+    _MC->queuePin(_IN2_A_pin, (latch_state & 0x1) ? HIGH : LOW);
+    _MC->queuePin(_IN1_B_pin, (latch_state & 0x2) ? HIGH : LOW);
+    _MC->queuePin(_IN1_A_pin, (latch_state & 0x4) ? HIGH : LOW);
+    _MC->queuePin(_IN2_B_pin, (latch_state & 0x8) ? HIGH : LOW);
 
     return _currentstep;
 }
@@ -69,6 +69,40 @@ public:
 
     void run(MotorDirection cmd);
     void setSpeed(uint8_t speed);
+    /// Set both the running direction \a cmd and the speed \a speed of this motor
+    void set(MotorDirection cmd, uint8_t speed)
+    {
+        queueRun(cmd);
+        queueSpeed(speed);
+        flush();
+    }
+
+    /**
+     * Queue a direction change
+     *
+     * Queue the input pin changes for running in direction \a cmd, without
+     * writing them to the shield. Returns \c false if \a cmd is not
+     * supported.
+     */
+    bool queueRun(MotorDirection cmd);
+    /// Queue a speed change to \a speed, without writing it to the shield
+    void queueSpeed(uint8_t speed);
+    /**
+     * Set the speed with full resolution
+     *
+     * Set the speed of this motor to \a speed, using the full 12 bit
+     * resolution of the PWM chip. The speed should be between 0 (stopped)
+     * and 4095 (full speed).
+     */
+    void setSpeed12(uint16_t speed)
+    {
+        queueSpeed12(speed);
+        flush();
+    }
+    /// Queue a 12 bit speed change to \a speed, without writing it to the shield
+    void queueSpeed12(uint16_t speed);
+    /// Write all queued changes to the shield
+    void flush();
 
 private:
     Adafruit_MotorShield *_MC;
@@ -94,6 +128,14 @@ public:
 
     void step(uint16_t steps, MotorDirection dir, StepStyle style=SINGLE);
     uint8_t onestep(MotorDirection dir, StepStyle style);
+    /**
+     * Queue a single step
+     *
+     * Compute the coil settings for a single step in direction \a dir, and
+     * queue them on the motor shield without writing them out. This allows
+     * steps of several motors to be written together in a single flush.
+     */
+    uint8_t queueStep(MotorDirection dir, StepStyle style);
     void release();
 
 private:
@@ -112,19 +154,90 @@ public:
     Adafruit_MotorShield(uint8_t addr = 0x60);
 
     void begin(uint16_t freq = 1600);
+    /// Return the PWM frequency in Hz
+    uint16_t pwmFreq() const { return _freq; }
+    /// Change the PWM frequency to \a freq Hz. This stops the outputs for about 5 ms.
+    void setPWMFreq(uint16_t freq)
+    {
+        _freq = freq;
+        _pwm.setPWMFreq(freq);
+    }
 
-    void setPWM(uint8_t pin, uint16_t val);
+    void setPWM(uint8_t pin, uint16_t val)
+    {
+        queuePWM(pin, val);
+        flush();
+    }
     void setPin(uint8_t pin, uint8_t val)
     {
-        _pwm.setPWM(pin, (val == LOW ? 0 : 4096), 0);
+        queuePin(pin, val);
+        flush();
+    }
+    /// Queue PWM value \a val for \a pin, without writing it to the chip
+    void queuePWM(uint8_t pin, uint16_t val)
+    {
+        Adafruit_PWMServoDriver::Channel ch = pwmChannel(val);
+        _pwm.queuePWM(pin, ch.on, ch.off);
     }
+    /// Queue digital output value \a val for \a pin, without writing it to the chip
+    void queuePin(uint8_t pin, uint8_t val)
+    {
+        Adafruit_PWMServoDriver::Channel ch = pinChannel(val);
+        _pwm.queuePWM(pin, ch.on, ch.off);
+    }
+    /// Write all queued channel changes to the chip
+    void flush() { _pwm.flush(); }
+    /**
+     * Set two DC motors at once
+     *
+     * Set the direction and speed of motors \a m1 and \a m2. The speeds are
+     * given with the full 12 bit resolution of the PWM chip, i.e. between 0
+     * (stopped) and 4095 (full speed). Only channels
+     * that actually change are written, and runs of adjacent changed channels
+     * (the channels of motors 1 and 2, and of motors 3 and 4, form contiguous
+     * blocks) are written in a single I2C transaction.
+     */
+    void setMotors(Adafruit_DCMotor* m1, MotorDirection dir1, uint16_t speed1,
+        Adafruit_DCMotor* m2, MotorDirection dir2, uint16_t speed2)
+    {
+        m1->queueRun(dir1);
+        m1->queueSpeed12(speed1);
+        m2->queueRun(dir2);
+        m2->queueSpeed12(speed2);
+        flush();
+    }
+    /// Return the PWM driver, e.g. for reading its transaction counters
+    const Adafruit_PWMServoDriver& driver() const { return _pwm; }
+    /// Turn off all channels in a single I2C transaction
+    void allOff() { _pwm.setAllPWM(0, 0); }
+
     Adafruit_DCMotor *getMotor(DCMotorName name)
     {
         return name >= 4 ? nullptr : (_dcmotors + name);
     }
     Adafruit_StepperMotor *getStepper(uint16_t steps, StepperName name);
 
+    /// Return the channel value for a PWM value \a val between 0 and 4096
+    static Adafruit_PWMServoDriver::Channel pwmChannel(uint16_t val)
+    {
+        Adafruit_PWMServoDriver::Channel ch = { 0, val };
+        if (val > 4095)
+        {
+            ch.on = 4096;
+            ch.off = 0;
+        }
+        return ch;
+    }
+    /// Return the channel value for a digital output value \a val
+    static Adafruit_PWMServoDriver::Channel pinChannel(uint8_t val)
+    {
+        Adafruit_PWMServoDriver::Channel ch = { uint16_t(val == LOW ? 0 : 4096), 0 };
+        return ch;
+    }
+
 private:
+    friend class MotorShieldGroup;
+
     uint8_t _addr;
     uint16_t _freq;
     Adafruit_DCMotor _dcmotors[4];
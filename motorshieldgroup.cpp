@@ -0,0 +1,77 @@
+#include "motorshieldgroup.h"
+
+bool MotorShieldGroup::add(Adafruit_MotorShield *shield)
+{
+    if (_count >= max_shields)
+        return false;
+
+    _shields[_count++] = shield;
+    return true;
+}
+
+void MotorShieldGroup::begin()
+{
+    // The ALLCALL address is enabled at power on
+    if (_addr == PCA9685_ALLCALL_I2C_ADDR)
+        return;
+
+    for (uint8_t i = 0; i < _count; ++i)
+        _shields[i]->_pwm.setSubAddress(_addr);
+}
+
+void MotorShieldGroup::allStop()
+{
+    if (!_count)
+        return;
+
+    _shields[0]->_pwm.writeAll(_addr, 0, 0);
+    for (uint8_t i = 0; i < _count; ++i)
+        _shields[i]->_pwm.assumeAllPWM(0, 0);
+}
+
+void MotorShieldGroup::setMotor(DCMotorName name, MotorDirection dir,
+    uint16_t speed)
+{
+    flush();
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        Adafruit_DCMotor *motor = _shields[i]->getMotor(name);
+        motor->queueRun(dir);
+        motor->queueSpeed12(speed);
+    }
+    _broadcast();
+}
+
+void MotorShieldGroup::setSpeed(uint16_t speed)
+{
+    flush();
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        for (uint8_t m = DC_MOTOR_1; m <= DC_MOTOR_4; ++m)
+            _shields[i]->getMotor(DCMotorName(m))->queueSpeed12(speed);
+    }
+    _broadcast();
+}
+
+void MotorShieldGroup::flush()
+{
+    for (uint8_t i = 0; i < _count; ++i)
+        _shields[i]->flush();
+}
+
+void MotorShieldGroup::_broadcast()
+{
+    // A channel may already hold the new value on some shields but not on
+    // others, so write every channel that changed on any of them. Since the
+    // same values were queued on all shields, the shadow registers of all
+    // shields agree on these channels.
+    uint16_t mask = 0;
+    for (uint8_t i = 0; i < _count; ++i)
+        mask |= _shields[i]->_pwm._dirty;
+    if (!mask)
+        return;
+
+    _shields[0]->_pwm.writeRuns(_addr, mask);
+    for (uint8_t i = 0; i < _count; ++i)
+        _shields[i]->_pwm._dirty = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef MOTORSHIELDGROUP_H
+#define MOTORSHIELDGROUP_H
+
+#include "motorshield.h"
+
+/**
+ * Class for driving a stack of motor shields together
+ *
+ * Class MotorShieldGroup drives several stacked motor shields, e.g. the two
+ * shields of a four wheel drive chassis, as a unit. All PWM chips in the group
+ * are made to respond to a shared I2C address, either the PCA9685 ALLCALL
+ * address, or a sub address programmed into each chip in begin(). Commands that
+ * are the same for every shield, such as stopping all motors or changing the
+ * speed of a motor port on all shields, are then written to the shared address
+ * once, instead of once for every shield.
+ *
+ * A broadcast takes one I2C transaction per run of adjacent channels that
+ * change, and a Wire transfer of 32 bytes holds at most 7 channels. The
+ * channels of a single motor port are adjacent, but the speed channels of
+ * the four ports (2, 7, 8 and 13) are not, so setSpeed() takes three
+ * transactions. Writing channels 2 to 13 in one transfer would need 49 bytes.
+ *
+ * The shadow registers of all shields are updated after a broadcast, so that
+ * the shields can still be driven individually as well. Updates for single
+ * shields can be queued on the shields themselves or their motors, and be
+ * written out with flush(). flush() only combines the updates queued on each
+ * shield, every shield is still written to separately.
+ */
+class MotorShieldGroup
+{
+public:
+    /// Maximum number of shields in a group
+    static const uint8_t max_shields = 4;
+
+    /**
+     * Constructor
+     *
+     * Create a new, empty, shield group, which is addressed on (7 bit) I2C
+     * address \a addr. If \a addr is \c PCA9685_ALLCALL_I2C_ADDR, the chips
+     * are addressed through their ALLCALL address, which is enabled by default
+     * but is shared with every other PCA9685 on the bus. Otherwise, \a addr is
+     * programmed as the first sub address of each chip in the group. The
+     * default is the power-on value of that sub address.
+     */
+    MotorShieldGroup(uint8_t addr = 0x71): _addr(addr), _count(0) {}
+
+    /**
+     * Add a shield to the group
+     *
+     * Add motor shield \a shield to this group. Returns \c false if the group
+     * is already full.
+     */
+    bool add(Adafruit_MotorShield *shield);
+    /**
+     * Initialize the group
+     *
+     * Make all shields in the group respond to the group address. This
+     * should be called after begin() was called on every shield.
+     */
+    void begin();
+
+    /// Return the number of shields in the group
+    uint8_t size() const { return _count; }
+    /// Return shield number \a idx in the group
+    Adafruit_MotorShield *shield(uint8_t idx) const
+    {
+        return idx < _count ? _shields[idx] : nullptr;
+    }
+
+    /**
+     * Stop all motors
+     *
+     * Turn off all channels of all shields in the group, releasing every
+     * motor, in a single I2C transaction.
+     */
+    void allStop();
+    /**
+     * Set a motor on all shields
+     *
+     * Set direction \a dir and 12 bit speed \a speed for the motor on port
+     * \a name of every shield in the group, in a single I2C transaction, since
+     * the channels of a port are adjacent. Any changes queued on the shields
+     * are flushed first.
+     */
+    void setMotor(DCMotorName name, MotorDirection dir, uint16_t speed);
+    /**
+     * Set the speed of all motors
+     *
+     * Set the 12 bit speed of every DC motor on every shield in the group to
+     * \a speed, without changing the running directions. The speed channels
+     * are written in three transactions, see above. Any changes queued on the
+     * shields are flushed first.
+     */
+    void setSpeed(uint16_t speed);
+    /// Write the changes queued on each shield in the group, shield by shield
+    void flush();
+
+private:
+    /// Shared I2C address of the group
+    uint8_t _addr;
+    /// The shields in the group
+    Adafruit_MotorShield *_shields[max_shields];
+    /// Number of shields in the group
+    uint8_t _count;
+
+    /**
+     * Broadcast the changes queued identically on all shields
+     *
+     * Write the channels queued on any shield to the group address, and mark
+     * them as written on every shield.
+     */
+    void _broadcast();
+};
+
+#endif // MOTORSHIELDGROUP_H
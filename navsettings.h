@@ -0,0 +1,36 @@
+#ifndef NAVSETTINGS_H
+#define NAVSETTINGS_H
+
+/*
+ * Navigation parameters of Robot.ino
+ *
+ * This file can be regenerated with tuned values by host/tune, which
+ * searches the parameters in simulated rooms. The parameters are variables
+ * defined in Robot.ino, so that they can also be changed over the serial
+ * port (see tunables.h); the values here are their defaults.
+ */
+
+#define NAV_PARAM(name, value) extern int name; const int name##_default = value
+
+/// Minimum distance from walls for full speed cruising, in cm
+NAV_PARAM(min_cruise_dist, 80);
+/// Distance to a wall below which a cruising robot stops, in cm
+NAV_PARAM(min_dist_soft, 20);
+/// Distance to a wall below which the robot never drives straight on, in cm
+NAV_PARAM(min_dist_hard, 15);
+/// Speed at full speed cruising
+NAV_PARAM(cruise_speed, 255);
+/// Speed at min_dist_hard, rising linearly to cruise_speed at min_cruise_dist
+NAV_PARAM(approach_speed, 50);
+/// Speed of the outer side when turning away from a wall
+NAV_PARAM(turn_speed, 128);
+/// Turning speed when turning away from a wall, 255 turns in place
+NAV_PARAM(turn_sharpness, 255);
+/// Steer around obstacles while moving (1), or only stop and turn at walls (0)
+NAV_PARAM(field_steering, 1);
+/// Distance within which obstacles push the robot away when steering, in cm
+NAV_PARAM(field_range, 90);
+/// Turning speed per unit of sideways push, times field_range
+NAV_PARAM(field_gain, 64);
+
+#endif // NAVSETTINGS_H
@@ -20,6 +20,7 @@
 
 #include <Wire.h>
 #include "pwmservodriver.h"
+#include "hal.h"
 
 #if defined(ARDUINO_SAM_DUE)
     #define WIRE Wire1
@@ -60,15 +61,114 @@ void Adafruit_PWMServoDriver::setPWMFreq(float freq)
                                             // This is why the beginTransmission below was not working.
 }
 
-void Adafruit_PWMServoDriver::setPWM(uint8_t num, uint16_t on, uint16_t off)
+void Adafruit_PWMServoDriver::setPWMs(uint8_t first, uint8_t count,
+    const Channel* channels)
 {
-    WIRE.beginTransmission(_i2c_addr);
-    WIRE_WRITE(LED0_ON_L+4*num);
+    for (uint8_t i = 0; i < count; ++i)
+        queuePWM(first + i, channels[i].on, channels[i].off);
+    flush();
+}
+
+void Adafruit_PWMServoDriver::setSubAddress(uint8_t addr)
+{
+    write8(PCA9685_SUBADR1, addr << 1);
+    uint8_t mode = read8(PCA9685_MODE1);
+    // Writing a zero to the restart bit has no effect
+    write8(PCA9685_MODE1, (mode & 0x7f) | PCA9685_MODE1_SUB1);
+}
+
+void Adafruit_PWMServoDriver::queuePWM(uint8_t num, uint16_t on, uint16_t off)
+{
+    uint16_t bit = 1 << num;
+    Channel ch = { on, off };
+    if ((_known & bit) && _shadow[num] == ch)
+        return;
+
+    _shadow[num] = ch;
+    _known |= bit;
+    _dirty |= bit;
+}
+
+void Adafruit_PWMServoDriver::flush()
+{
+    if (!_dirty)
+    {
+        ++_suppressed;
+        return;
+    }
+
+    writeRuns(_i2c_addr, _dirty);
+    _dirty = 0;
+}
+
+void Adafruit_PWMServoDriver::writeRuns(uint8_t addr, uint16_t mask)
+{
+    uint8_t first = 0;
+    while (mask)
+    {
+        // Skip to the start of the next run of channels
+        while (!(mask & 1))
+        {
+            mask >>= 1;
+            ++first;
+        }
+        uint8_t count = 0;
+        while (mask & 1)
+        {
+            mask >>= 1;
+            ++count;
+        }
+        writePWMs(addr, first, count);
+        first += count;
+    }
+}
+
+void Adafruit_PWMServoDriver::writePWMs(uint8_t addr, uint8_t first,
+    uint8_t count)
+{
+    const Channel* channels = _shadow + first;
+    while (count > 0)
+    {
+        uint8_t n = count < _max_burst ? count : _max_burst;
+        WIRE.beginTransmission(addr);
+        WIRE_WRITE(LED0_ON_L+4*first);
+        for (uint8_t i = 0; i < n; ++i)
+        {
+            WIRE_WRITE((uint8_t)channels[i].on);
+            WIRE_WRITE((uint8_t)(channels[i].on>>8));
+            WIRE_WRITE((uint8_t)channels[i].off);
+            WIRE_WRITE((uint8_t)(channels[i].off>>8));
+        }
+        WIRE.endTransmission();
+        ++_transactions;
+
+        first += n;
+        channels += n;
+        count -= n;
+    }
+}
+
+void Adafruit_PWMServoDriver::writeAll(uint8_t addr, uint16_t on, uint16_t off)
+{
+    WIRE.beginTransmission(addr);
+    WIRE_WRITE(ALLLED_ON_L);
     WIRE_WRITE((uint8_t)on);
     WIRE_WRITE((uint8_t)(on>>8));
     WIRE_WRITE((uint8_t)off);
     WIRE_WRITE((uint8_t)(off>>8));
     WIRE.endTransmission();
+    ++_transactions;
+}
+
+void Adafruit_PWMServoDriver::assumeAllPWM(uint16_t on, uint16_t off)
+{
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        _shadow[i].on = on;
+        _shadow[i].off = off;
+    }
+    _known = 0xffff;
+    _dirty = 0;
 }
 
 uint8_t Adafruit_PWMServoDriver::read8(uint8_t addr)
@@ -26,11 +26,21 @@
 #else
  #include "WProgram.h"
 #endif
+#include <Wire.h>
 
 
 #define PCA9685_SUBADR1 0x2
 #define PCA9685_SUBADR2 0x3
 #define PCA9685_SUBADR3 0x4
+#define PCA9685_ALLCALLADR 0x5
+
+#define PCA9685_MODE1_ALLCALL 0x01
+#define PCA9685_MODE1_SUB3 0x02
+#define PCA9685_MODE1_SUB2 0x04
+#define PCA9685_MODE1_SUB1 0x08
+
+/// Default (7 bit) I2C address to which all PCA9685 chips respond
+#define PCA9685_ALLCALL_I2C_ADDR 0x70
 
 #define PCA9685_MODE1 0x0
 #define PCA9685_PRESCALE 0xFE
@@ -48,16 +58,109 @@
 
 class Adafruit_PWMServoDriver {
  public:
-  Adafruit_PWMServoDriver(uint8_t addr = 0x40): _i2c_addr(addr) {}
+  /// On and off counts of a single PWM channel
+  struct Channel
+  {
+    uint16_t on;
+    uint16_t off;
+
+    bool operator==(const Channel& ch) const
+    {
+      return on == ch.on && off == ch.off;
+    }
+  };
+
+  Adafruit_PWMServoDriver(uint8_t addr = 0x40):
+    _i2c_addr(addr), _known(0), _dirty(0),
+    _transactions(0), _suppressed(0) {}
 
   void begin();
   void reset() { write8(PCA9685_MODE1, 0x0); }
   void setPWMFreq(float freq);
-  void setPWM(uint8_t num, uint16_t on, uint16_t off);
+  /// Set channel \a num, and write it out together with any queued changes
+  void setPWM(uint8_t num, uint16_t on, uint16_t off)
+  {
+    queuePWM(num, on, off);
+    flush();
+  }
+  /**
+   * Set multiple channels at once
+   *
+   * Set the on and off counts of the \a count consecutive channels starting
+   * at channel \a first, and write out all changed channels.
+   * \param first    The first channel to set
+   * \param count    The number of channels to set
+   * \param channels The new channel values
+   */
+  void setPWMs(uint8_t first, uint8_t count, const Channel* channels);
+  /// Set all sixteen channels to the same on and off counts in a single write
+  void setAllPWM(uint16_t on, uint16_t off)
+  {
+    writeAll(_i2c_addr, on, off);
+    assumeAllPWM(on, off);
+  }
+  /**
+   * Set a sub address
+   *
+   * Make the chip respond to (7 bit) I2C address \a addr as its first sub
+   * address, in addition to its own address. When several chips share a sub
+   * address, they can all be written to in a single transaction.
+   */
+  void setSubAddress(uint8_t addr);
+
+  /**
+   * Queue a channel update
+   *
+   * Store new on and off counts for channel \a num in the shadow registers,
+   * without writing them to the chip. If the channel already has these
+   * values, nothing changes.
+   */
+  void queuePWM(uint8_t num, uint16_t on, uint16_t off);
+  /**
+   * Write out queued changes
+   *
+   * Write all channels that were changed since the last flush to the chip.
+   * Each run of consecutive changed channels is sent in a single I2C
+   * transaction, using the auto-increment mode of the chip (split into
+   * chunks of seven channels to fit the Wire buffer).
+   */
+  void flush();
+
+  /// Return the number of I2C transactions used to write channel values
+  uint32_t transactions() const { return _transactions; }
+  /// Return the number of flushes that were skipped since nothing changed
+  uint32_t suppressedTransactions() const { return _suppressed; }
+  /// Reset the transaction counters to zero
+  void resetCounters() { _transactions = _suppressed = 0; }
 
  private:
-  uint8_t _i2c_addr;
+  // The group writes to the chip through a shared address, and needs to
+  // keep the shadow registers up to date.
+  friend class MotorShieldGroup;
 
+  /// Maximum number of channels fitting in a single Wire transmission
+  static const uint8_t _max_burst = (BUFFER_LENGTH - 1) / 4;
+
+  uint8_t _i2c_addr;
+  /// Copy of the LED registers of all channels, as written or queued
+  Channel _shadow[16];
+  /// Bit mask of channels whose shadow register holds a known value
+  uint16_t _known;
+  /// Bit mask of channels with changes not yet written to the chip
+  uint16_t _dirty;
+  /// Number of I2C transactions issued for channel writes
+  uint32_t _transactions;
+  /// Number of flushes suppressed because no channel changed
+  uint32_t _suppressed;
+
+  /// Write the channels in bit mask \a mask to I2C address \a addr
+  void writeRuns(uint8_t addr, uint16_t mask);
+  /// Write \a count shadow registers starting at channel \a first to I2C address \a addr
+  void writePWMs(uint8_t addr, uint8_t first, uint8_t count);
+  /// Set all channels of the chip(s) at I2C address \a addr at once
+  void writeAll(uint8_t addr, uint16_t on, uint16_t off);
+  /// Record that all channels were set to \a on and \a off by other means
+  void assumeAllPWM(uint16_t on, uint16_t off);
   uint8_t read8(uint8_t addr);
   void write8(uint8_t addr, uint8_t d);
 };
@@ -3,8 +3,16 @@
 
 /// Interval of timer1 interrupt in microseconds
 const uint16_t timer1_us = 50;
-/// number of timer ticks for music update
-const uint16_t music_ticks = 1000 / timer1_us;          // 1000 Hz
+/// number of timer ticks for engine speed update
+const uint16_t engine_ticks = 10000 / timer1_us;        // 100 Hz
+/// Maximum engine speed increase per speed update (12 bit speed units)
+const uint16_t engine_accel = 128;
+/// Maximum engine speed decrease per speed update (12 bit speed units)
+const uint16_t engine_decel = 256;
+/// Time to brake the motors when stopping in front of an obstacle, in ms
+const uint16_t engine_brake_ms = 150;
+/// PWM frequency of the motor shield in Hz
+const uint16_t motor_pwm_freq = 1600;
 /// Trigger distance sensor every trigger_ticks ticks
 const uint16_t US_trigger_ticks = 100000ul / timer1_us; // 10 Hz
 /// Read infra red sensors every IR_trigger_ticks ticks
@@ -14,11 +22,11 @@ const uint16_t US_max_distance = 500;
 
 const uint8_t US_trigger_pin = 4;       // Distance sensor trigger pin
 const uint8_t US_echo_pin = 2;          // Distance sensor echo pin
-const uint8_t piezo_pin = 8;            // Piezo element pin
 const uint8_t IR_pins[] = {A0, A1, A2}; // front IR distance sensor pins (center, left, right)
 
 // Note: some pins reserved:
 // A4 and A5: I2C pins
+// D11: piezo element, driven by the synthesizer (OC2A)
 // D2 and D3: interrupt pins
 
 #endif
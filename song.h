@@ -1,16 +1,25 @@
 #ifndef SONG_H
 #define SONG_H
 
+#include "songcompiler.h"
+#include "synth.h"
+#include "hal.h"
+
 /**
  * Class for simple songs
  *
- * Class Song is used to play simple tunes on a piezo element. The songs are
+ * Class Song is used to play simple tunes on a voice of the synthesizer. The songs are
  * described as simple ASCII text strings in a simplified abc notation (only
  * note names, sharps and flats, and note lengths are recognised. No keys,
- * repeats, or whitespace. Output on the piezo is done using the tone()
- * function. To keep the song playing, its update() function should be called
- * every millisecond (i.e. with a frequency of 1 kHz), most likely from a timer
- * ISR.
+ * repeats, or whitespace, see SongCompiler). The descriptions are compiled
+ * into tables of notes at build time, so playing a tune is a simple walk
+ * through the table. Since the synthesizer has several voices, several songs
+ * can be played at the same time, e.g. a melody and a bass line.
+ *
+ * The time at which the next note starts is kept as an absolute deadline, so
+ * the tempo does not drift, no matter how irregularly update() is called. To
+ * keep the song playing, update() should be called regularly, e.g. on every
+ * pass through the main loop; it only does work when the next note is due.
  */
 class Song
 {
@@ -18,52 +27,75 @@ public:
     /**
      * Constructor
      *
-     * Create a new Song object for the tune described in \a desc. The duration
-     * in milliseconds of a single note, without length denotation, is given by
-     * \a note_length. The \a octave argument specifies the base octave of the
-     * tune; when octave = 4 (the default), an A will be 440Hz.
-     * \param desc        abc description of the tune
-     * \param note_length length of a single note in ms
-     * \param octave      base octave of the tune
+     * Create a new Song object for a tune compiled into the \a count note
+     * events in program memory at \a events, to be played on voice \a voice
+     * of synthesizer \a synth.
+     * \param events Note events of the tune, in program memory
+     * \param count  Number of events in the tune
+     * \param synth  The synthesizer to play the tune on
+     * \param voice  The synthesizer voice to play the tune with
      */
-    Song(const char* desc, int note_length=250, int octave=4):
-        _desc(desc), _note_length(note_length), _octave(octave) {}
+    Song(const NoteEvent* events, uint16_t count, Synth* synth, uint8_t voice=0):
+        _events(events), _count(count), _synth(synth), _voice(voice),
+        _cur_event(0), _next_ms(0), _playing(false) {}
+
+    /**
+     * Compile a tune
+     *
+     * Create a new Song object for the tune described in \a Desc, which
+     * should be a \c constexpr character array, to be played on voice
+     * \a voice of synthesizer \a synth. The duration in milliseconds
+     * of a single note, without length denotation, is given by \a NoteLength.
+     * The \a Octave argument specifies the base octave of the tune; when
+     * octave = 4 (the default), an A will be 440Hz. A malformed description
+     * is a compile error.
+     */
+    template <const char* Desc, int NoteLength=250, int Octave=4>
+    static Song compile(Synth* synth, uint8_t voice=0)
+    {
+        typedef CompiledSong<Desc, NoteLength, Octave> Compiled;
+        return Song(Compiled::events, Compiled::size, synth, voice);
+    }
 
     /// Start or restart playing the tune
     void start()
     {
-        _cur_char = _desc;
-        _cur_ms = 0;
+        _cur_event = 0;
+        _next_ms = millis();
+        _playing = true;
     }
     /// Stop playing this tune
-    void stop() { _cur_ms = -1; }
+    void stop() { _playing = false; }
     /// Return \c true if this tune has finished playing, \c false otherwise
-    bool finished() const { return _cur_ms < 0; }
+    bool finished() const { return !_playing; }
 
     /**
      * Update the current playing position
      *
-     * Update the timestamp of the tune. If the current not has finished,
-     * parse a new note and start playing it. This function should be called
-     * every millisecond.
+     * If the current note has finished at time \a now (in ms, as returned by
+     * millis()), start playing the next one. When called late, notes that
+     * should already have ended are skipped, and the note that should be
+     * playing now is played for the remainder of its duration.
+     * \param now The current time in milliseconds
      */
-    void update();
+    void update(uint32_t now);
 
 private:
-    /// Description of the tune to play, in simplified abc notation
-    const char *_desc;
-    /// Length of a single note, in ms
-    int _note_length;
-    /// Octave offset of the tune
-    int _octave;
-
-    /// Pointer in the description string to the next note to play
-    const char* _cur_char;
-    /// Number of ms the current note still needs to play, or -1 when song has finished.
-    int _cur_ms;
+    /// Note events of the tune, in program memory
+    const NoteEvent* _events;
+    /// Number of note events
+    uint16_t _count;
+    /// The synthesizer playing the tune
+    Synth* _synth;
+    /// The synthesizer voice playing the tune
+    uint8_t _voice;
 
-    /// Return the length in ms of the next note in the description
-    int _getLength();
+    /// Index of the next note event to play
+    uint16_t _cur_event;
+    /// Time (millis()) at which the next note starts
+    uint32_t _next_ms;
+    /// Whether the tune is playing
+    bool _playing;
 };
 
-#endif // SONG_H
\ No newline at end of file
+#endif // SONG_H
@@ -0,0 +1,223 @@
+#ifndef SONGCOMPILER_H
+#define SONGCOMPILER_H
+
+#include <Arduino.h>
+
+/// A single note or rest in a compiled tune
+struct NoteEvent
+{
+    /// Frequency of the note in Hz, or 0 for a rest
+    uint16_t freq;
+    /// Duration of the note in ms
+    uint16_t ms;
+};
+
+/**
+ * Compile time parser for tunes
+ *
+ * Class SongCompiler parses tunes in the simplified abc notation used by Song
+ * at compile time, so that no parsing or floating point arithmetic is needed
+ * while a tune plays. Its functions are only meant to be evaluated by the
+ * compiler, through CompiledSong; they are written as C++11 constexpr
+ * functions, i.e. as single return statements using recursion.
+ *
+ * A tune is a sequence of notes, each consisting of
+ * - a note name \c A - \c G or \c a - \c g (one octave higher), or a rest
+ *   \c z or \c x,
+ * - for notes, an optional octave mark: \c , for one octave lower, \c ' for
+ *   one octave higher,
+ * - for notes, an optional accidental: \c ^ (sharp) or \c _ (flat),
+ * - an optional length: a multiplier \c 1 - \c 9, optionally followed by
+ *   \c / (half), \c // (quarter), or \c / followed by a divisor \c 1 - \c 9.
+ *
+ * Positions in the description are passed as indices; a position of 0 after
+ * a note signals a parse error.
+ */
+class SongCompiler
+{
+public:
+    /// Return \c true if the tune description \a desc is well formed
+    static constexpr bool valid(const char* desc, unsigned pos=0)
+    {
+        return desc[pos] == '\0' || _validFrom(desc, _noteEnd(desc, pos));
+    }
+    /// Return the number of notes and rests in tune description \a desc
+    static constexpr unsigned count(const char* desc, unsigned pos=0)
+    {
+        return desc[pos] == '\0' || _noteEnd(desc, pos) == 0 ? 0
+            : 1 + count(desc, _noteEnd(desc, pos));
+    }
+    /// Return the position of note number \a n in tune description \a desc
+    static constexpr unsigned position(const char* desc, unsigned n,
+        unsigned pos=0)
+    {
+        return n == 0 ? pos : position(desc, n-1, _noteEnd(desc, pos));
+    }
+    /**
+     * Compile a single note
+     *
+     * Return the event for the note at position \a pos in tune description
+     * \a desc, for a tune with single notes of \a note_length ms in base
+     * octave \a octave. The frequency is truncated to whole Hz, like tone()
+     * does with a floating point frequency.
+     */
+    static constexpr NoteEvent event(const char* desc, unsigned pos,
+        int note_length, int octave)
+    {
+        return _isRest(desc[pos])
+            ? NoteEvent{ 0, _length(desc, pos+1, note_length) }
+            : NoteEvent{ uint16_t(_pitch(desc, pos, octave)),
+                _length(desc, _pitchEnd(desc, pos), note_length) };
+    }
+
+private:
+    static constexpr bool _isDigit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool _isRest(char c) { return c == 'z' || c == 'x'; }
+    static constexpr bool _isPitch(char c)
+    {
+        return (c >= 'A' && c <= 'G') || (c >= 'a' && c <= 'g');
+    }
+
+    static constexpr bool _validFrom(const char* desc, unsigned pos)
+    {
+        return pos != 0 && valid(desc, pos);
+    }
+
+    /// Return the position after the note at \a pos, or 0 if it is malformed
+    static constexpr unsigned _noteEnd(const char* desc, unsigned pos)
+    {
+        return _isRest(desc[pos]) ? _lengthEnd(desc, pos+1)
+            : _isPitch(desc[pos]) ? _lengthEnd(desc, _pitchEnd(desc, pos))
+            : 0;
+    }
+    /// Return the position after the pitch of the note at \a pos
+    static constexpr unsigned _pitchEnd(const char* desc, unsigned pos)
+    {
+        return _accidentalEnd(desc, _octaveEnd(desc, pos+1));
+    }
+    static constexpr unsigned _octaveEnd(const char* desc, unsigned pos)
+    {
+        return desc[pos] == ',' || desc[pos] == '\'' ? pos+1 : pos;
+    }
+    static constexpr unsigned _accidentalEnd(const char* desc, unsigned pos)
+    {
+        return desc[pos] == '^' || desc[pos] == '_' ? pos+1 : pos;
+    }
+    /// Return the position after the length at \a pos, or 0 if it is malformed
+    static constexpr unsigned _lengthEnd(const char* desc, unsigned pos)
+    {
+        return desc[pos] == '0' ? 0
+            : _fractionEnd(desc, _isDigit(desc[pos]) ? pos+1 : pos);
+    }
+    static constexpr unsigned _fractionEnd(const char* desc, unsigned pos)
+    {
+        return desc[pos] != '/' ? pos
+            : desc[pos+1] == '/' ? pos+2
+            : desc[pos+1] == '0' ? 0
+            : _isDigit(desc[pos+1]) ? pos+2
+            : pos+1;
+    }
+
+    /// Return the length in ms of the note with length at \a pos
+    static constexpr uint16_t _length(const char* desc, unsigned pos,
+        int note_length)
+    {
+        return uint16_t(note_length * _multiplier(desc, pos)
+            / _divisor(desc, _isDigit(desc[pos]) ? pos+1 : pos));
+    }
+    static constexpr int _multiplier(const char* desc, unsigned pos)
+    {
+        return _isDigit(desc[pos]) ? desc[pos] - '0' : 1;
+    }
+    static constexpr int _divisor(const char* desc, unsigned pos)
+    {
+        return desc[pos] != '/' ? 1
+            : desc[pos+1] == '/' ? 4
+            : _isDigit(desc[pos+1]) ? desc[pos+1] - '0'
+            : 2;
+    }
+
+    /// Return the frequency of the note at \a pos in Hz
+    static constexpr float _pitch(const char* desc, unsigned pos, int octave)
+    {
+        return _scale(_accidental(_baseFrequency(desc[pos]),
+                desc[_octaveEnd(desc, pos+1)]),
+            octave - 4 + (desc[pos] >= 'a' ? 1 : 0)
+                + (desc[pos+1] == ',' ? -1 : desc[pos+1] == '\'' ? 1 : 0));
+    }
+    /// Return the frequency of note name \a c in the 4th octave
+    static constexpr float _baseFrequency(char c)
+    {
+        return _octave4(c >= 'a' ? c - 'a' : c - 'A');
+    }
+    /// Hz values for ground tones in 4th octave (A, B, C, D, E, F, G),
+    /// equal tempered scale, A = 440Hz
+    static constexpr float _octave4(int idx)
+    {
+        return idx == 0 ? 440.0f
+            : idx == 1 ? float(493.8833012561241)
+            : idx == 2 ? float(261.6255653005986)
+            : idx == 3 ? float(293.6647679174076)
+            : idx == 4 ? float(329.6275569128699)
+            : idx == 5 ? float(349.2282314330039)
+            : float(391.99543598174927);
+    }
+    /// Raise or lower \a pitch by a half note, depending on accidental \a c
+    static constexpr float _accidental(float pitch, char c)
+    {
+        // distance between half notes in equal tempered scale [ = 2**(1/12) ]
+        return c == '^' ? pitch * float(1.0594630943592953)
+            : c == '_' ? pitch / float(1.0594630943592953)
+            : pitch;
+    }
+    /// Multiply \a pitch by 2 to the power \a shift
+    static constexpr float _scale(float pitch, int shift)
+    {
+        return shift > 0 ? _scale(pitch * 2, shift-1)
+            : shift < 0 ? _scale(pitch / 2, shift+1)
+            : pitch;
+    }
+};
+
+/// A compile time sequence of indices
+template <unsigned... I>
+struct IndexSequence {};
+/// Generate IndexSequence<0, ..., N-1>
+template <unsigned N, unsigned... I>
+struct MakeIndexSequence: MakeIndexSequence<N-1, N-1, I...> {};
+template <unsigned... I>
+struct MakeIndexSequence<0, I...>
+{
+    typedef IndexSequence<I...> type;
+};
+
+/**
+ * Tune compiled at build time
+ *
+ * Struct CompiledSong holds the table of note events in program memory for
+ * the tune described by \a Desc, with single notes of \a NoteLength ms and
+ * base octave \a Octave. The description should be a \c constexpr character
+ * array. A malformed tune fails to compile.
+ */
+template <const char* Desc, int NoteLength, int Octave,
+    typename Indices=typename MakeIndexSequence<SongCompiler::count(Desc)>::type>
+struct CompiledSong;
+
+template <const char* Desc, int NoteLength, int Octave, unsigned... I>
+struct CompiledSong<Desc, NoteLength, Octave, IndexSequence<I...>>
+{
+    static_assert(SongCompiler::valid(Desc), "malformed tune");
+    static_assert(sizeof...(I) > 0, "empty tune");
+
+    /// Number of events in the tune
+    static const uint16_t size = sizeof...(I);
+    /// The note events, in program memory
+    static const NoteEvent events[sizeof...(I)];
+};
+
+template <const char* Desc, int NoteLength, int Octave, unsigned... I>
+const NoteEvent CompiledSong<Desc, NoteLength, Octave, IndexSequence<I...>>::events[sizeof...(I)] PROGMEM = {
+    SongCompiler::event(Desc, SongCompiler::position(Desc, I), NoteLength, Octave)...
+};
+
+#endif // SONGCOMPILER_H
@@ -0,0 +1,258 @@
+#include "steppercontrol.h"
+
+namespace
+{
+
+// Number of 2^-32 fractions in a millionth: converts (steps per second) times
+// (microseconds per tick) into 2^-32 steps per tick.
+const float frac_per_micro = 4294.967296;
+
+} // namespace
+
+void StepProfile::setMaxSpeed(uint16_t steps_per_s)
+{
+    float v = float(steps_per_s) * _tick_us;
+    // At most one step per tick
+    uint32_t speed = v >= 1.0e6 ? 0xffffffff : uint32_t(v * frac_per_micro);
+
+    noInterrupts();
+    _max_speed = speed;
+    interrupts();
+}
+
+void StepProfile::setAcceleration(uint16_t steps_per_s2)
+{
+    float a = float(steps_per_s2) * _tick_us * _tick_us * 1.0e-6;
+    uint32_t accel = max(uint32_t(a * frac_per_micro), uint32_t(1));
+
+    noInterrupts();
+    _accel = accel;
+    interrupts();
+}
+
+void StepProfile::start(uint32_t steps)
+{
+    noInterrupts();
+    _speed = 0;
+    _min_speed = 0;
+    _phase = 0;
+    _accel_steps = 0;
+    _remaining = steps;
+    _state = ACCELERATING;
+    interrupts();
+}
+
+void StepProfile::setDistance(uint32_t steps)
+{
+    noInterrupts();
+    uint32_t remaining = steps > _pending ? steps - _pending : 0;
+    if (remaining <= _accel_steps)
+    {
+        remaining = _accel_steps;
+        _state = DECELERATING;
+    }
+    else if (_state == DECELERATING)
+    {
+        _state = ACCELERATING;
+    }
+    _remaining = remaining;
+    interrupts();
+}
+
+uint32_t StepProfile::decelerate()
+{
+    noInterrupts();
+    if (_remaining > _accel_steps)
+        _remaining = _accel_steps;
+    _state = DECELERATING;
+    uint32_t steps = _remaining + _pending;
+    interrupts();
+
+    return steps;
+}
+
+bool StepProfile::active() const
+{
+    noInterrupts();
+    bool res = _remaining != 0;
+    interrupts();
+    return res;
+}
+
+uint16_t StepProfile::takePending()
+{
+    noInterrupts();
+    uint16_t res = _pending;
+    _pending = 0;
+    interrupts();
+    return res;
+}
+
+void StepProfile::tick()
+{
+    if (!_remaining)
+        return;
+
+    switch (_state)
+    {
+        case ACCELERATING:
+            if (_speed < _max_speed && _max_speed - _speed > _accel)
+            {
+                _speed += _accel;
+            }
+            else
+            {
+                _speed = _max_speed;
+                _state = CRUISING;
+            }
+            break;
+        case DECELERATING:
+            if (_speed - _min_speed > _accel)
+                _speed -= _accel;
+            else
+                _speed = _min_speed;
+            break;
+        default:
+            /* nothing */ ;
+    }
+
+    uint32_t phase = _phase + _speed;
+    bool step = phase < _phase;
+    _phase = phase;
+    if (!step)
+        return;
+
+    ++_pending;
+    if (--_remaining == 0)
+    {
+        _speed = 0;
+        _state = ACCELERATING;
+        return;
+    }
+
+    if (_state == DECELERATING)
+    {
+        if (_accel_steps > 0)
+            --_accel_steps;
+    }
+    else
+    {
+        if (_state == ACCELERATING)
+        {
+            ++_accel_steps;
+            if (!_min_speed)
+                _min_speed = _speed;
+        }
+        if (_remaining <= _accel_steps)
+            _state = DECELERATING;
+    }
+}
+
+void StepperControl::moveTo(int32_t position)
+{
+    _target = position;
+    if (!_profile.active())
+        return;
+
+    int32_t delta = _target - _position;
+    if (_dir == FORWARD ? delta > 0 : delta < 0)
+        _profile.setDistance(labs(delta));
+    else
+        _profile.decelerate();
+}
+
+void StepperControl::stop()
+{
+    if (!_profile.active())
+    {
+        _target = _position;
+        return;
+    }
+
+    int32_t steps = _profile.decelerate();
+    _target = _dir == FORWARD ? _position + steps : _position - steps;
+}
+
+void StepperControl::run()
+{
+    // Check whether the move is still active before collecting the steps, so
+    // that no new steps can come in after a finished move was seen.
+    bool active = _profile.active();
+
+    uint16_t n = _profile.takePending();
+    int8_t inc = _dir == FORWARD ? 1 : -1;
+    for ( ; n > 0; --n)
+    {
+        _motor->onestep(_dir, _style);
+        _position += inc;
+    }
+
+    if (!active && _position != _target)
+        _startMove();
+}
+
+void StepperControl::_startMove()
+{
+    int32_t delta = _target - _position;
+    _dir = delta > 0 ? FORWARD : BACKWARD;
+    _profile.start(labs(delta));
+}
+
+bool StepperPair::moveTo(int32_t x, int32_t y)
+{
+    if (running())
+        return false;
+
+    int32_t dx = x - _x, dy = y - _y;
+    _dir_x = dx < 0 ? BACKWARD : FORWARD;
+    _dir_y = dy < 0 ? BACKWARD : FORWARD;
+
+    uint32_t adx = labs(dx), ady = labs(dy);
+    _x_major = adx >= ady;
+    _major_steps = _x_major ? adx : ady;
+    _minor_steps = _x_major ? ady : adx;
+    _major_left = _major_steps;
+    _error = 0;
+
+    _profile.start(_major_steps);
+    return true;
+}
+
+void StepperPair::stop()
+{
+    _profile.decelerate();
+}
+
+void StepperPair::run()
+{
+    bool active = _profile.active();
+
+    uint16_t n = _profile.takePending();
+    for ( ; n > 0 && _major_left > 0; --n, --_major_left)
+    {
+        bool step_x = _x_major, step_y = !_x_major;
+        _error += _minor_steps;
+        if (2*_error >= int32_t(_major_steps))
+        {
+            _error -= _major_steps;
+            step_x = step_y = true;
+        }
+
+        if (step_x)
+        {
+            _motor_x->queueStep(_dir_x, _style);
+            _x += _dir_x == FORWARD ? 1 : -1;
+        }
+        if (step_y)
+        {
+            _motor_y->queueStep(_dir_y, _style);
+            _y += _dir_y == FORWARD ? 1 : -1;
+        }
+        // Write the coils of both motors together
+        _shield->flush();
+    }
+
+    // Stopped before the end of the move
+    if (!active)
+        _major_left = 0;
+}
@@ -0,0 +1,290 @@
+#ifndef STEPPERCONTROL_H
+#define STEPPERCONTROL_H
+
+#include <Arduino.h>
+#include "motorshield.h"
+
+/**
+ * Class for trapezoidal step timing
+ *
+ * Class StepProfile generates the timing of the steps in a move with a
+ * trapezoidal velocity profile: the stepping rate ramps up with a constant
+ * acceleration until the maximum speed is reached, then stays constant, and
+ * ramps down again with the same rate so that the motor comes to a halt on
+ * the last step. Moves too short to reach full speed get a triangular profile.
+ *
+ * The profile is computed incrementally in tick(), which should be called
+ * from a timer interrupt handler at a fixed interval. The speed is kept as a
+ * fraction of a step per tick, which is added to a phase accumulator every
+ * tick; a step is due whenever the accumulator overflows. This costs only a
+ * few additions per tick, without any multiplications or divisions.
+ *
+ * The steps themselves are not taken in the interrupt handler, since the
+ * motor shield is controlled over I2C, which cannot be used from an ISR. The
+ * steps due are counted instead, and should be collected from the main loop
+ * using takePending().
+ */
+class StepProfile
+{
+public:
+    /**
+     * Constructor
+     *
+     * Create a new step profile generator, for a tick() function called every
+     * \a tick_us microseconds.
+     */
+    StepProfile(uint16_t tick_us):
+        _tick_us(tick_us), _max_speed(0), _accel(0), _min_speed(0),
+        _speed(0), _phase(0), _remaining(0), _accel_steps(0), _pending(0),
+        _state(ACCELERATING) {}
+
+    /// Set the maximum speed in steps per second
+    void setMaxSpeed(uint16_t steps_per_s);
+    /// Set the acceleration and deceleration in steps per second squared
+    void setAcceleration(uint16_t steps_per_s2);
+
+    /**
+     * Start a new move
+     *
+     * Start a new move of \a steps steps from standstill. Any move currently
+     * in progress is aborted.
+     */
+    void start(uint32_t steps);
+    /**
+     * Change the length of the current move
+     *
+     * Change the number of steps still to be taken in the current move to
+     * \a steps, counting steps that are due but not yet collected. If the
+     * motor cannot be stopped within this distance, it is brought to a halt
+     * as soon as possible instead, and will overshoot.
+     */
+    void setDistance(uint32_t steps);
+    /**
+     * Decelerate to a stop as soon as possible
+     *
+     * Bring the motor to a halt within the braking distance. Returns the number
+     * of steps still to be taken until the motor stands still, counting steps
+     * that are due but not yet collected.
+     */
+    uint32_t decelerate();
+
+    /// Return \c true if steps are still being generated
+    bool active() const;
+    /// Return the number of steps due, and reset the count to zero
+    uint16_t takePending();
+
+    /**
+     * Handle timer tick
+     *
+     * Update the speed and determine if the next step is due. This function
+     * should be called from a timer interrupt handler every \a tick_us
+     * microseconds.
+     */
+    void tick();
+
+private:
+    /// Phase of the move
+    enum State: uint8_t
+    {
+        ACCELERATING,
+        CRUISING,
+        DECELERATING
+    };
+
+    /// Interval between calls to tick() in microseconds
+    uint16_t _tick_us;
+    /// Maximum speed, in 2^-32 steps per tick
+    uint32_t _max_speed;
+    /// Speed change per tick, in 2^-32 steps per tick
+    uint32_t _accel;
+    /// Speed after the first step, used as a floor when decelerating
+    volatile uint32_t _min_speed;
+    /// Current speed, in 2^-32 steps per tick
+    volatile uint32_t _speed;
+    /// Phase accumulator, a step is due when it overflows
+    volatile uint32_t _phase;
+    /// Number of steps still to be generated in this move
+    volatile uint32_t _remaining;
+    /// Number of steps taken while accelerating, i.e. the braking distance
+    volatile uint32_t _accel_steps;
+    /// Number of steps due, but not yet collected by takePending()
+    volatile uint16_t _pending;
+    /// Current phase of the move
+    volatile State _state;
+};
+
+/**
+ * Class for non-blocking stepper motor control
+ *
+ * Class StepperControl moves a stepper motor on the motor shield to a target
+ * position in the background, with a trapezoidal velocity profile, so that
+ * the motor can be run at its full speed without stalling when starting or
+ * stopping. The step timing is generated by a StepProfile, whose tick()
+ * function should be called from a timer interrupt; the steps are taken by
+ * calling run() from the main loop as often as possible.
+ */
+class StepperControl
+{
+public:
+    /**
+     * Constructor
+     *
+     * Create a new stepper controller for \a motor, driven by a timer
+     * interrupt calling tick() every \a tick_us microseconds, and stepping
+     * with step style \a style.
+     */
+    StepperControl(Adafruit_StepperMotor *motor, uint16_t tick_us,
+        StepStyle style=DOUBLE):
+        _motor(motor), _profile(tick_us), _style(style), _dir(FORWARD),
+        _position(0), _target(0) {}
+
+    /// Set the maximum speed in steps per second
+    void setMaxSpeed(uint16_t steps_per_s) { _profile.setMaxSpeed(steps_per_s); }
+    /// Set the acceleration and deceleration in steps per second squared
+    void setAcceleration(uint16_t steps_per_s2)
+    {
+        _profile.setAcceleration(steps_per_s2);
+    }
+
+    /// Move to absolute position \a position
+    void moveTo(int32_t position);
+    /// Move \a steps steps relative to the current target position
+    void move(int32_t steps) { moveTo(_target + steps); }
+    /// Decelerate to a stop as soon as possible
+    void stop();
+
+    /// Return the current position of the motor, in steps
+    int32_t position() const { return _position; }
+    /// Return the position the motor is moving to
+    int32_t target() const { return _target; }
+    /// Return \c true if the motor is still moving
+    bool running() const { return _profile.active() || _position != _target; }
+
+    /// Handle a timer tick. Call this from the timer interrupt handler.
+    void tick() { _profile.tick(); }
+    /**
+     * Take steps
+     *
+     * Take the steps that are due, and start moving toward the target
+     * position when the motor has come to a halt away from it. This function
+     * should be called from the main loop as often as possible.
+     */
+    void run();
+
+private:
+    /// The motor to drive
+    Adafruit_StepperMotor *_motor;
+    /// Generator for the step timing
+    StepProfile _profile;
+    /// Stepping style
+    StepStyle _style;
+    /// Direction of the current move
+    MotorDirection _dir;
+    /// Current position
+    int32_t _position;
+    /// Target position
+    int32_t _target;
+
+    /// Start a new move from standstill toward the target position
+    void _startMove();
+};
+
+/**
+ * Class for coordinated motion of two stepper motors
+ *
+ * Class StepperPair moves the two stepper motors on a motor shield together
+ * in a straight line, e.g. for a pan/tilt head or an X-Y plotter. The axis
+ * with the largest distance to travel (the major axis) is stepped with a
+ * trapezoidal velocity profile generated by a StepProfile, and the other
+ * axis follows using Bresenham interpolation, so that both axes start and
+ * finish together. As with StepperControl, tick() should be called from a
+ * timer interrupt, and run() from the main loop.
+ */
+class StepperPair
+{
+public:
+    /**
+     * Constructor
+     *
+     * Create a new controller for the steppers with \a steps steps per
+     * revolution, connected to both stepper ports of \a shield. The first
+     * stepper moves along the x axis, the second along the y axis. The
+     * controller is driven by a timer interrupt calling tick() every
+     * \a tick_us microseconds, and steps with step style \a style.
+     */
+    StepperPair(Adafruit_MotorShield *shield, uint16_t steps,
+        uint16_t tick_us, StepStyle style=DOUBLE):
+        _shield(shield), _motor_x(shield->getStepper(steps, STEPPER_1)),
+        _motor_y(shield->getStepper(steps, STEPPER_2)), _profile(tick_us),
+        _style(style), _x(0), _y(0), _major_left(0) {}
+
+    /// Set the maximum speed along the major axis in steps per second
+    void setMaxSpeed(uint16_t steps_per_s) { _profile.setMaxSpeed(steps_per_s); }
+    /// Set the acceleration along the major axis in steps per second squared
+    void setAcceleration(uint16_t steps_per_s2)
+    {
+        _profile.setAcceleration(steps_per_s2);
+    }
+
+    /**
+     * Move to a position
+     *
+     * Start moving in a straight line to absolute position (\a x, \a y).
+     * Returns \c false if the previous move has not finished yet, in which
+     * case the new move is ignored.
+     */
+    bool moveTo(int32_t x, int32_t y);
+    /**
+     * Move by a distance
+     *
+     * Start moving in a straight line over (\a dx, \a dy) steps. Returns
+     * \c false if the previous move has not finished yet, in which case the
+     * new move is ignored.
+     */
+    bool move(int32_t dx, int32_t dy) { return moveTo(_x + dx, _y + dy); }
+    /**
+     * Stop moving
+     *
+     * Decelerate to a stop as soon as possible. The motors stop on the line
+     * to the original target.
+     */
+    void stop();
+
+    /// Return the current position along the x axis
+    int32_t x() const { return _x; }
+    /// Return the current position along the y axis
+    int32_t y() const { return _y; }
+    /// Return \c true if the motors are still moving
+    bool running() const { return _profile.active() || _major_left > 0; }
+
+    /// Handle a timer tick. Call this from the timer interrupt handler.
+    void tick() { _profile.tick(); }
+    /// Take the steps that are due. Call this from the main loop.
+    void run();
+
+private:
+    /// The shield the motors are connected to
+    Adafruit_MotorShield *_shield;
+    /// The motor moving along the x axis
+    Adafruit_StepperMotor *_motor_x;
+    /// The motor moving along the y axis
+    Adafruit_StepperMotor *_motor_y;
+    /// Generator for the step timing of the major axis
+    StepProfile _profile;
+    /// Stepping style
+    StepStyle _style;
+    /// Current position
+    int32_t _x, _y;
+    /// Step directions along both axes
+    MotorDirection _dir_x, _dir_y;
+    /// Whether x is the major axis
+    bool _x_major;
+    /// Number of steps along the major and minor axis in this move
+    uint32_t _major_steps, _minor_steps;
+    /// Number of major axis steps not yet taken
+    uint32_t _major_left;
+    /// Bresenham error term
+    int32_t _error;
+};
+
+#endif // STEPPERCONTROL_H
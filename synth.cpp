@@ -0,0 +1,205 @@
+#include "synth.h"
+
+namespace
+{
+
+// One period of a sine wave
+const int8_t sine_table[64] PROGMEM = {
+       0,   12,   25,   37,   49,   60,   71,   81,   90,   98,  106,  112,  117,  122,  125,  126,
+     127,  126,  125,  122,  117,  112,  106,   98,   90,   81,   71,   60,   49,   37,   25,   12,
+       0,  -12,  -25,  -37,  -49,  -60,  -71,  -81,  -90,  -98, -106, -112, -117, -122, -125, -126,
+    -127, -126, -125, -122, -117, -112, -106,  -98,  -90,  -81,  -71,  -60,  -49,  -37,  -25,  -12,
+};
+
+inline int8_t waveSample(Synth::Waveform waveform, uint16_t phase)
+{
+    switch (waveform)
+    {
+        case Synth::SINE:
+            return pgm_read_byte(sine_table + (phase >> 10));
+        case Synth::SQUARE:
+            return phase & 0x8000 ? -127 : 127;
+        default:
+            return int8_t((phase >> 8) - 128);
+    }
+}
+
+} // namespace
+
+const Synth::Envelope Synth::default_envelope = { 0, 4, 160, 16 };
+
+Synth::Synth(): _tick_count(0), _last_t0(0), _sample_count(0), _max_cycles(0), _overruns(0)
+{
+    for (uint8_t i = 0; i < nr_voices; ++i)
+    {
+        volatile Voice& v = _voices[i];
+        v.phase = 0;
+        v.increment = 0;
+        v.waveform = SQUARE;
+        _setEnvelope(v, default_envelope);
+        v.stage = OFF;
+        v.level = 0;
+        v.gate = 0;
+    }
+}
+
+void Synth::begin()
+{
+    pinMode(output_pin, OUTPUT);
+
+    noInterrupts();
+    TCCR2A = (1 << COM2A1) | (1 << WGM21) | (1 << WGM20);  // fast PWM on OC2A
+    TCCR2B = (1 << CS20);                                   // no prescaler
+    OCR2A = 128;                                            // silence
+    // The overflow interrupt is enabled by the first note
+    TIMSK2 = 0;
+    interrupts();
+}
+
+void Synth::setVoice(uint8_t voice, Waveform waveform, const Envelope& envelope)
+{
+    if (voice >= nr_voices)
+        return;
+
+    noInterrupts();
+    _voices[voice].waveform = waveform;
+    _setEnvelope(_voices[voice], envelope);
+    interrupts();
+}
+
+void Synth::noteOn(uint8_t voice, uint16_t freq, uint16_t ms)
+{
+    if (voice >= nr_voices)
+        return;
+
+    uint16_t increment = (uint32_t(freq) << 16) / sample_rate;
+    // There are 125/512 envelope updates per ms
+    uint16_t gate = max((uint32_t(ms) * 125) >> 9, uint32_t(1));
+
+    noInterrupts();
+    volatile Voice& v = _voices[voice];
+    v.increment = increment;
+    v.gate = gate;
+    v.level = 0;
+    v.stage = ATTACK;
+    _start();
+    interrupts();
+}
+
+void Synth::noteOff(uint8_t voice)
+{
+    if (voice >= nr_voices)
+        return;
+
+    noInterrupts();
+    if (_voices[voice].stage != OFF)
+        _voices[voice].stage = RELEASE;
+    interrupts();
+}
+
+void Synth::_sample()
+{
+    // A handler running longer than an overflow period swallows overflows,
+    // which makes this sample late. Timer0 shows how long it has been since
+    // the previous sample, within a few µs.
+    uint8_t t0 = TCNT0;
+    const uint8_t max_t0 = timer0_per_sample + timer0_per_sample / overflows_per_sample;
+    bool late = uint8_t(t0 - _last_t0) > max_t0;
+    _last_t0 = t0;
+
+    int16_t mix = 0;
+    for (uint8_t i = 0; i < nr_voices; ++i)
+    {
+        volatile Voice& v = _voices[i];
+        if (!v.level)
+            continue;
+        uint16_t phase = v.phase + v.increment;
+        v.phase = phase;
+        mix += (waveSample(v.waveform, phase) * v.level) >> 8;
+    }
+    // Two voices at full level fit in the output range, more are clipped
+    int16_t out = 128 + (mix >> 1);
+    OCR2A = out < 0 ? 0 : out > 255 ? 255 : out;
+
+    uint8_t idx = ++_sample_count & (envelope_interval-1);
+    if (idx < nr_voices)
+        _updateEnvelope(_voices[idx]);
+
+    // Stop the interrupt once all notes have faded out
+    bool sounding = false;
+    for (uint8_t i = 0; i < nr_voices; ++i)
+        sounding |= _voices[i].stage != OFF;
+    if (!sounding)
+    {
+        TIMSK2 = 0;
+        OCR2A = 128;
+    }
+
+    // The counter counts up from the overflow that triggered this sample at
+    // one count per cycle, however late the handler started. If it wrapped
+    // around, the overflow flag, cleared on entering the handler, is set again.
+    uint8_t cycles = TCNT2;
+    if (late || (TIFR2 & (1 << TOV2)) || cycles > budget_cycles)
+        ++_overruns;
+    else if (cycles > _max_cycles)
+        _max_cycles = cycles;
+}
+
+void Synth::_start()
+{
+    if (TIMSK2 & (1 << TOIE2))
+        return;
+
+    // Count from the next overflow, and do not take the time since the last
+    // note for a late sample
+    _tick_count = 0;
+    _last_t0 = TCNT0;
+    TIFR2 = (1 << TOV2);
+    TIMSK2 = (1 << TOIE2);
+}
+
+void Synth::_updateEnvelope(volatile Voice& v)
+{
+    if (v.stage < RELEASE && --v.gate == 0)
+        v.stage = RELEASE;
+
+    switch (v.stage)
+    {
+        case ATTACK:
+            if (!v.envelope.attack || v.level >= 255 - v.envelope.attack)
+            {
+                v.level = 255;
+                v.stage = DECAY;
+            }
+            else
+            {
+                v.level += v.envelope.attack;
+            }
+            break;
+        case DECAY:
+            if (!v.envelope.decay
+                || v.level <= v.envelope.sustain + v.envelope.decay)
+            {
+                v.level = v.envelope.sustain;
+                v.stage = SUSTAIN;
+            }
+            else
+            {
+                v.level -= v.envelope.decay;
+            }
+            break;
+        case RELEASE:
+            if (!v.envelope.release || v.level <= v.envelope.release)
+            {
+                v.level = 0;
+                v.stage = OFF;
+            }
+            else
+            {
+                v.level -= v.envelope.release;
+            }
+            break;
+        default:
+            /* nothing */ ;
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <Arduino.h>
+
+/**
+ * Class for a wavetable synthesizer
+ *
+ * Class Synth generates sound on a piezo element or small speaker using
+ * direct digital synthesis. Timer2 runs in fast PWM mode without prescaler,
+ * giving an inaudible PWM carrier of 62.5 kHz on its OC2A pin (pin 11 on the
+ * Uno). On every fourth overflow of the timer, i.e. at 15625 Hz, tick()
+ * computes a new sample and writes it to the PWM duty cycle. The other
+ * overflows only count, inline in the interrupt handler. The overflow
+ * interrupt is only enabled while a note sounds, so a silent synthesizer
+ * costs nothing. The cost of the handler, both kinds of overflow included,
+ * is measured by the timer2_isr benchmark of CycleBench.
+ *
+ * Each of the voices has a 16 bit phase accumulator, a waveform, and a simple
+ * envelope (attack, decay, sustain, release). Notes are started with
+ * noteOn(), much like tone(), and released automatically when their duration
+ * has passed. The envelopes are updated at a lower rate, one voice per
+ * sample, so that the work per sample is bounded.
+ *
+ * Since Timer2 is used, tone() cannot be used together with this class.
+ */
+class Synth
+{
+public:
+    /// Number of voices, between 2 and 4
+    static const uint8_t nr_voices = 3;
+    /// Output pin, the OC2A pin of Timer2
+    static const uint8_t output_pin = 11;
+    /// Number of timer overflows per sample, a power of two
+    static const uint8_t overflows_per_sample = 4;
+    /// Number of samples per second
+    static const uint16_t sample_rate = F_CPU / 256 / overflows_per_sample;
+    /// Number of samples between envelope updates of a voice
+    static const uint8_t envelope_interval = 64;
+    /**
+     * Number of CPU cycles a sample may take, counted from the timer overflow
+     * that triggers it, so that a late start counts against it. This must be
+     * less than the 256 cycles between overflows. Together with the three
+     * overflows that only count, this should leave more than half of the
+     * time between samples for the main program.
+     */
+    static const uint8_t budget_cycles = 250;
+    /// Number of Timer0 counts per sample; Timer0 runs at F_CPU/64 for millis()
+    static const uint8_t timer0_per_sample = overflows_per_sample * 256 / 64;
+
+    /// Waveform of a voice
+    enum Waveform: uint8_t
+    {
+        SINE,
+        SQUARE,
+        SAWTOOTH
+    };
+
+    /**
+     * Envelope of a voice
+     *
+     * The level of a note first rises by \a attack per envelope update until
+     * the maximum level of 255, then falls by \a decay until it reaches the
+     * \a sustain level. When the note is released, the level drops by
+     * \a release per update until the note is silent. A rate of zero means
+     * the change is immediate. Envelope updates occur every 4.1 ms.
+     */
+    struct Envelope
+    {
+        uint8_t attack;
+        uint8_t decay;
+        uint8_t sustain;
+        uint8_t release;
+    };
+
+    /// Constructor
+    Synth();
+
+    /// Set up Timer2 and the output pin, and start producing samples
+    void begin();
+
+    /**
+     * Set the sound of a voice
+     *
+     * Set the waveform of voice \a voice to \a waveform, and its envelope to
+     * \a envelope. The change takes effect at the next note.
+     */
+    void setVoice(uint8_t voice, Waveform waveform, const Envelope& envelope);
+
+    /**
+     * Play a note
+     *
+     * Start playing a note of \a freq Hz for \a ms milliseconds on voice
+     * \a voice, cutting off any note still playing on that voice. After
+     * \a ms milliseconds, the note is released.
+     */
+    void noteOn(uint8_t voice, uint16_t freq, uint16_t ms);
+    /// Release the note playing on voice \a voice
+    void noteOff(uint8_t voice);
+    /// Return \c true if a note is sounding on voice \a voice
+    bool active(uint8_t voice) const { return _voices[voice].stage != OFF; }
+
+    /// Return the largest number of cycles a sample took, within the budget
+    uint8_t maxCycles() const { return _max_cycles; }
+    /**
+     * Return the number of samples that exceeded the cycle budget, or that
+     * came late because another interrupt handler held up the overflows
+     */
+    uint16_t overruns() const { return _overruns; }
+
+    /**
+     * Handle timer overflow
+     *
+     * Compute and output the next sample on every fourth call. This function
+     * should be called from the Timer2 overflow interrupt handler.
+     */
+    void tick()
+    {
+        if (++_tick_count & (overflows_per_sample-1))
+            return;
+        _sample();
+    }
+
+private:
+    /// Phase of a note's envelope
+    enum Stage: uint8_t
+    {
+        ATTACK,
+        DECAY,
+        SUSTAIN,
+        RELEASE,
+        OFF
+    };
+
+    /// State of a single voice
+    struct Voice
+    {
+        /// Phase accumulator, one period is 2^16
+        uint16_t phase;
+        /// Phase increment per sample
+        uint16_t increment;
+        /// Waveform of the voice
+        Waveform waveform;
+        /// Envelope of the voice
+        Envelope envelope;
+        /// Current phase of the envelope
+        Stage stage;
+        /// Current envelope level
+        uint8_t level;
+        /// Number of envelope updates until the note is released
+        uint16_t gate;
+    };
+
+    /// Envelope of a voice that was not set up
+    static const Envelope default_envelope;
+
+    /// Number of overflows, the low bits count the overflows since the last sample
+    uint8_t _tick_count;
+    /// Timer0 count at the last sample
+    uint8_t _last_t0;
+    /// Number of samples output, used to schedule envelope updates
+    uint8_t _sample_count;
+    /// Largest number of cycles used by a sample within the budget
+    volatile uint8_t _max_cycles;
+    /// Number of samples exceeding the cycle budget
+    volatile uint16_t _overruns;
+    /// The voices
+    volatile Voice _voices[nr_voices];
+
+    /// Set the envelope of voice \a v to \a envelope
+    static void _setEnvelope(volatile Voice& v, const Envelope& envelope)
+    {
+        v.envelope.attack = envelope.attack;
+        v.envelope.decay = envelope.decay;
+        v.envelope.sustain = envelope.sustain;
+        v.envelope.release = envelope.release;
+    }
+    /// Update the envelope of voice \a v
+    static void _updateEnvelope(volatile Voice& v);
+    /// Compute and output the next sample
+    void _sample();
+    /// Enable the overflow interrupt, if it is not running yet
+    void _start();
+};
+
+#endif // SYNTH_H
@@ -0,0 +1,123 @@
+#include <util/crc16.h>
+#include "telemetry.h"
+#include "hal.h"
+
+namespace
+{
+
+/// Store \a value as a varint at \a dest, and return the number of bytes used
+uint8_t putVarint(uint8_t* dest, uint32_t value)
+{
+    uint8_t n = 0;
+    while (value >= 0x80)
+    {
+        dest[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    dest[n++] = value;
+    return n;
+}
+
+/// Map a signed value onto an unsigned one, keeping small magnitudes small
+inline uint16_t zigzag(int16_t value)
+{
+    return (uint16_t(value) << 1) ^ uint16_t(value >> 15);
+}
+
+} // namespace
+
+void Telemetry::begin()
+{
+    Serial.begin(baud_rate);
+}
+
+bool Telemetry::send(Channel& ch, uint32_t ms, const int16_t* values)
+{
+    if (--ch._countdown != 0)
+        return true;
+    ch._countdown = ch._decimation;
+
+    if (_queue(ch, ms, values))
+        return true;
+
+    // Let the next frame of the channel be decodable without this one
+    ch._since_keyframe = 0;
+    ++ch._dropped;
+    ++_dropped;
+    return false;
+}
+
+void Telemetry::poll()
+{
+    if (_dropped != _reported)
+    {
+        int16_t stats[2] = { int16_t(_dropped), _high_water };
+        if (_queue(_stats, millis(), stats))
+            _reported = _dropped;
+    }
+
+    int room = Serial.availableForWrite();
+    while (room-- > 0 && _used)
+    {
+        Serial.write(_ring[_start]);
+        _start = (_start + 1) % ring_size;
+        --_used;
+    }
+}
+
+bool Telemetry::_queue(Channel& ch, uint32_t ms, const int16_t* values)
+{
+    uint8_t frame[max_frame];
+    bool key = ch._since_keyframe == 0;
+    uint8_t len = 0;
+    frame[len++] = ch._id | (key ? 0x80 : 0);
+    frame[len++] = _seq++;
+    len += putVarint(frame + len, key ? ms : ms - ch._last_ms);
+    for (uint8_t i = 0; i < ch._nr_fields; ++i)
+        len += putVarint(frame + len, zigzag(key ? values[i] : values[i] - ch._last[i]));
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < len; ++i)
+        crc = _crc8_ccitt_update(crc, frame[i]);
+    frame[len++] = crc;
+
+    if (!_put(frame, len))
+        return false;
+
+    ch._last_ms = ms;
+    memcpy(ch._last, values, ch._nr_fields * sizeof(values[0]));
+    if (++ch._since_keyframe == keyframe_interval)
+        ch._since_keyframe = 0;
+    return true;
+}
+
+bool Telemetry::_put(const uint8_t* frame, uint8_t len)
+{
+    // COBS adds one byte per 254 data bytes, plus the terminating zero
+    if (_used + len + 2 > ring_size)
+        return false;
+
+    uint8_t end = _start + _used;
+    uint8_t code_pos = end;
+    uint8_t code = 1;
+    ++end;
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        if (frame[i] == 0)
+        {
+            _ring[code_pos % ring_size] = code;
+            code_pos = end++;
+            code = 1;
+        }
+        else
+        {
+            _ring[end++ % ring_size] = frame[i];
+            ++code;
+        }
+    }
+    _ring[code_pos % ring_size] = code;
+    _ring[end++ % ring_size] = 0;
+
+    _used += len + 2;
+    _high_water = max(_high_water, _used);
+    return true;
+}
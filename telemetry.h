@@ -0,0 +1,132 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+/**
+ * Binary telemetry over the serial port
+ *
+ * Class Telemetry sends samples of the robot's state in compact binary
+ * frames, without ever blocking the control loop: frames are queued in a
+ * ring buffer, which poll() moves into the serial transmit buffer as far as
+ * it has room. When a frame does not fit in the ring, it is dropped and
+ * counted, see dropped().
+ *
+ * Samples are sent on channels, each with a fixed number of 16 bit fields
+ * and a decimation factor: only every n-th sample offered to a channel is
+ * sent. Every frame, before framing, consists of:
+ *  - the channel number, with bit 7 set in a key frame;
+ *  - a sequence number, counting all frames offered, including dropped ones;
+ *  - the time in ms as a varint: absolute in a key frame, else the increase
+ *    since the channel's previous frame;
+ *  - the fields as zigzag varints: absolute in a key frame, else the change
+ *    since the channel's previous frame;
+ *  - a CRC-8 (polynomial 0x07) over the bytes before it.
+ * Varints are little endian base 128. A channel sends a key frame every
+ * \c keyframe_interval frames, and after one of its frames was dropped, so
+ * a decoder can pick up the stream anywhere. Frames are COBS encoded and
+ * terminated by a zero byte. The stream starts with a zero byte as well.
+ *
+ * Channel 0 is reserved for the statistics of the stream itself: it is sent
+ * after frames were dropped, with the total number of dropped frames and the
+ * highest fill level of the ring in bytes.
+ */
+class Telemetry
+{
+public:
+    /// Baud rate of the serial port
+    static const uint32_t baud_rate = 115200;
+    /// Size of the ring buffer, a power of two
+    static const uint16_t ring_size = 128;
+    /// Maximum number of fields of a channel
+    static const uint8_t max_fields = 8;
+    /// Maximum number of frames of a channel between key frames
+    static const uint8_t keyframe_interval = 32;
+    /// Channel number of the statistics
+    static const uint8_t stats_channel = 0;
+
+    /// A channel of samples
+    class Channel
+    {
+    public:
+        /**
+         * Create channel \a id with \a nr_fields fields, sending every
+         * \a decimation -th sample.
+         */
+        Channel(uint8_t id, uint8_t nr_fields, uint8_t decimation=1):
+            _id(id), _nr_fields(nr_fields), _decimation(decimation),
+            _countdown(1), _since_keyframe(0), _dropped(0), _last_ms(0), _last{0} {}
+
+        /// Return the number of frames of this channel that were dropped
+        uint16_t dropped() const { return _dropped; }
+
+    private:
+        friend class Telemetry;
+
+        uint8_t _id;
+        uint8_t _nr_fields;
+        uint8_t _decimation;
+        /// Samples until the next one is sent
+        uint8_t _countdown;
+        /// Frames since the last key frame, 0 to force a key frame
+        uint8_t _since_keyframe;
+        uint16_t _dropped;
+        uint32_t _last_ms;
+        int16_t _last[max_fields];
+    };
+
+    /// Constructor
+    Telemetry(): _stats(stats_channel, 2), _ring{0}, _start(0), _used(1),
+        _high_water(0), _seq(0), _dropped(0), _reported(0)
+    {
+        // Start with a frame delimiter, so that a decoder discards any text
+        // sent before the first frame
+    }
+
+    /// Open the serial port at \c baud_rate
+    void begin();
+    /**
+     * Offer a sample
+     *
+     * Offer the sample of \a ch taken at time \a ms, with one value in
+     * \a values for each field of the channel. Depending on the decimation
+     * of the channel, the sample is queued or ignored. This never blocks.
+     * \return \c false if the sample was dropped because the ring was full.
+     */
+    bool send(Channel& ch, uint32_t ms, const int16_t* values);
+    /**
+     * Move queued bytes to the serial port, as far as they fit in its
+     * transmit buffer. Call this frequently, e.g. every pass through loop().
+     */
+    void poll();
+
+    /// Return the total number of frames dropped
+    uint16_t dropped() const { return _dropped; }
+    /// Return the highest number of bytes queued in the ring so far
+    uint8_t highWater() const { return _high_water; }
+
+private:
+    /// Longest frame before encoding: header, time, fields and CRC
+    static const uint8_t max_frame = 2 + 5 + 3 * max_fields + 1;
+    static_assert(max_frame < 254, "a frame must fit in a single COBS block");
+
+    Channel _stats;
+    uint8_t _ring[ring_size];
+    uint8_t _start;
+    uint8_t _used;
+    uint8_t _high_water;
+    uint8_t _seq;
+    uint16_t _dropped;
+    /// Value of _dropped in the last statistics frame
+    uint16_t _reported;
+
+    /**
+     * Encode the frame for sample \a values of \a ch, and queue it. Returns
+     * \c false if it does not fit.
+     */
+    bool _queue(Channel& ch, uint32_t ms, const int16_t* values);
+    /// COBS encode the \a len bytes in \a frame into the ring, if they fit
+    bool _put(const uint8_t* frame, uint8_t len);
+};
+
+#endif // TELEMETRY_H
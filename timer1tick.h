@@ -0,0 +1,32 @@
+#ifndef TIMER1TICK_H
+#define TIMER1TICK_H
+
+#include "eyes.h"
+#include "settings.h"
+
+/**
+ * Body of the timer1 interrupt handler
+ *
+ * Triggers the sensors of \a eyes, and returns true every engine_ticks
+ * calls, when the engine speed should be updated. It is shared by the robot
+ * sketch and CycleBench, so that the benchmark measures the code the robot
+ * runs; HAL calls are left to the handler in the sketch.
+ */
+inline bool timer1Tick(Eyes& eyes)
+{
+    static uint16_t cur_engine_tick = 1;
+    bool update_engine = false;
+
+    // Update engine speed
+    if (--cur_engine_tick == 0)
+    {
+        cur_engine_tick = engine_ticks;
+        update_engine = true;
+    }
+
+//    eyes.ultrasoundTick();
+    eyes.infraredTick();
+    return update_engine;
+}
+
+#endif // TIMER1TICK_H
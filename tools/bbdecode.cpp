@@ -0,0 +1,117 @@
+/*
+ * Decoder for black box recordings
+ *
+ * Reads the output of the BlackBoxDump sketch from standard input, and writes
+ * the recorded frames as CSV to standard output. Times are in ms relative to
+ * the last recorded frame. See blackbox.h for the recording format.
+ *
+ * Build with: g++ -std=c++11 -O2 -o bbdecode bbdecode.cpp
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Must match BlackBox::Frame
+const unsigned nr_fields = 8;
+const uint8_t keyframe = 0xff;
+const char* const state_names[] = { "CRUISING", "BRAKING", "TURNING", "HALT" };
+
+typedef std::vector<uint8_t> Frame;
+
+bool readDump(std::vector<uint8_t>& bytes)
+{
+    char line[256];
+    unsigned expected = 0;
+    bool started = false;
+    while (fgets(line, sizeof(line), stdin))
+    {
+        if (!started)
+        {
+            started = sscanf(line, "BLACKBOX %u", &expected) == 1;
+            continue;
+        }
+        if (!strncmp(line, "END", 3))
+            break;
+        for (const char* p = line; p[0] && p[1]; p += 2)
+        {
+            unsigned b;
+            if (sscanf(p, "%2x", &b) != 1)
+                break;
+            bytes.push_back(b);
+        }
+    }
+
+    if (!started)
+    {
+        fprintf(stderr, "No black box dump found\n");
+        return false;
+    }
+    if (bytes.size() != expected)
+    {
+        fprintf(stderr, "Expected %u bytes, got %zu\n", expected, bytes.size());
+        return false;
+    }
+    return true;
+}
+
+bool decode(const std::vector<uint8_t>& bytes, std::vector<Frame>& frames)
+{
+    Frame cur(nr_fields, 0);
+    size_t pos = 0;
+    while (pos < bytes.size())
+    {
+        uint8_t mask = bytes[pos++];
+        if (frames.empty() && mask != keyframe)
+        {
+            fprintf(stderr, "Recording does not start with a key frame\n");
+            return false;
+        }
+        for (unsigned i = 0; i < nr_fields; ++i)
+        {
+            if (mask == keyframe || (mask & (1 << i)))
+            {
+                if (pos >= bytes.size())
+                {
+                    fprintf(stderr, "Truncated frame at byte %zu\n", pos);
+                    return false;
+                }
+                cur[i] = mask == keyframe ? bytes[pos] : uint8_t(cur[i] + bytes[pos]);
+                ++pos;
+            }
+        }
+        frames.push_back(cur);
+    }
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<uint8_t> bytes;
+    std::vector<Frame> frames;
+    if (!readDump(bytes) || !decode(bytes, frames))
+        return 1;
+
+    // Frame times, counting back from the last frame
+    std::vector<long> times(frames.size(), 0);
+    for (size_t i = frames.size(); i-- > 1; )
+        times[i-1] = times[i] - frames[i][7];
+
+    printf("t_ms,dist_center,dist_left,dist_right,state,speed_left,speed_right,heading_deg,loop_ms\n");
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const Frame& f = frames[i];
+        std::string state = f[3] < 4 ? state_names[f[3]] : std::to_string(f[3]);
+        printf("%ld,%u,%u,%u,%s,%d,%d,%.1f,%u\n", times[i], f[0], f[1], f[2],
+            state.c_str(), int8_t(f[4]) * 32, int8_t(f[5]) * 32,
+            f[6] * 360.0 / 256, f[7]);
+    }
+    return 0;
+}
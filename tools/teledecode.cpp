@@ -0,0 +1,595 @@
+/*
+ * Decoder and analyzer for telemetry streams
+ *
+ * Decodes the binary telemetry sent by the robot code (see telemetry.h) from
+ * a capture file, a serial port or standard input, and prints statistics of
+ * every channel: the range, mean and standard deviation of each field, a
+ * histogram of the intervals between frames, and the control latency, the
+ * time from a change of an input field until an output field responds. The
+ * decoded samples can also be exported as CSV, or as columns of raw binary
+ * values, which numpy.fromfile() and similar can load directly.
+ *
+ * Files are mapped into memory, so captures of many hours decode in seconds.
+ * A serial port is set to raw mode at the given baud rate and decoded until
+ * it is closed or the decoder is interrupted.
+ *
+ * Usage: teledecode [options] [capture file or serial port]
+ *   -b baud        baud rate of a serial port (default 115200)
+ *   -c path        write all samples as CSV to path
+ *   -o dir         write the samples of every channel as columns in dir
+ *   -l ch:in:out   measure the latency from field in to field out of channel
+ *                  ch (default 1:0:2, distance to left speed)
+ *   -q             do not print the statistics
+ *
+ * Build with: g++ -std=c++11 -O2 -o teledecode teledecode.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Must match telemetry.h
+const unsigned max_fields = 8;
+const unsigned nr_channels = 128;
+const uint8_t keyframe_flag = 0x80;
+
+// Field names of the known channels, must match Robot.ino
+struct ChannelInfo
+{
+    const char* name;
+    std::vector<const char*> fields;
+};
+const ChannelInfo known_channels[] = {
+    { "stats", { "dropped", "high_water" } },
+    { "control", { "dist", "state", "speed_left", "speed_right", "ir_center",
+        "ir_left", "ir_right" } },
+    // Replies to parameter commands, see tunables.h
+    { "tunables", { "index", "value" } },
+    // Counts of the sensor to motor command latencies since the previous
+    // frame, see latencyhistogram.h
+    { "latency", { "lt1ms", "lt2ms", "lt4ms", "lt8ms", "lt16ms", "lt32ms", "lt64ms",
+        "ge64ms" } }
+};
+
+// Intervals between frames in the histogram, in ms; longer ones are counted
+// in the last bin
+const unsigned histogram_bins = 64;
+// Changes of the output field later than this are no response, in ms
+const uint32_t max_latency_ms = 1000;
+
+volatile sig_atomic_t interrupted = 0;
+
+uint8_t crc8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+/// Read a varint at \a pos, and advance \a pos. Returns \c false if it is truncated.
+bool getVarint(const uint8_t*& pos, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; pos < end && shift < 35; shift += 7)
+    {
+        uint8_t b = *pos++;
+        value |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/// Running mean and variance, with Welford's method
+struct FieldStats
+{
+    uint64_t n = 0;
+    double mean = 0, m2 = 0;
+    int min = INT32_MAX, max = INT32_MIN;
+
+    void add(int v)
+    {
+        ++n;
+        double d = v - mean;
+        mean += d / n;
+        m2 += d * (v - mean);
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+    double stddev() const { return n > 1 ? sqrt(m2 / (n - 1)) : 0; }
+};
+
+/// Writes the samples of a channel as one file of raw values per column
+struct ColumnWriter
+{
+    FILE* seq = nullptr;
+    FILE* time = nullptr;
+    FILE* fields[max_fields] = {};
+};
+
+struct Channel
+{
+    bool seen = false;
+    /// Whether the previous frame was decoded, so that deltas can be applied
+    bool synced = false;
+    unsigned nr_fields = 0;
+    uint32_t ms = 0;
+    int16_t values[max_fields];
+
+    uint64_t frames = 0, keyframes = 0, unsynced = 0;
+    FieldStats stats[max_fields];
+    uint64_t periods[histogram_bins] = {};
+    /// Value of Decoder::_gaps at the previous frame
+    uint64_t gaps_at_last = 0;
+
+    // Latency measurement: time of an input change still waiting for a
+    // response, and the previous values of the input and output fields
+    bool waiting = false;
+    uint32_t change_ms = 0;
+    int16_t prev_in = 0, prev_out = 0;
+    std::vector<uint32_t> latencies;
+
+    ColumnWriter columns;
+};
+
+struct Options
+{
+    FILE* csv = nullptr;
+    std::string columns_dir;
+    int latency_channel = 1;
+    unsigned latency_in = 0, latency_out = 2;
+};
+
+/// Streaming decoder of the telemetry frames
+class Decoder
+{
+public:
+    explicit Decoder(const Options& options): _options(options) {}
+
+    /// Decode the \a len bytes at \a data
+    void feed(const uint8_t* data, size_t len)
+    {
+        _bytes += len;
+        const uint8_t* end = data + len;
+        while (data < end)
+        {
+            // Collect the bytes up to the next delimiter; most frames are
+            // decoded straight from the input
+            const uint8_t* zero = static_cast<const uint8_t*>(memchr(data, 0, end - data));
+            if (!zero)
+            {
+                _partial.insert(_partial.end(), data, end);
+                return;
+            }
+            if (_partial.empty())
+            {
+                _frame(data, zero - data);
+            }
+            else
+            {
+                _partial.insert(_partial.end(), data, zero);
+                _frame(_partial.data(), _partial.size());
+                _partial.clear();
+            }
+            data = zero + 1;
+        }
+    }
+
+    void printStats(FILE* f) const;
+    void closeColumns();
+
+private:
+    const Options& _options;
+    Channel _channels[nr_channels];
+    std::vector<uint8_t> _partial;
+    uint64_t _bytes = 0, _frames = 0, _bad = 0, _gaps = 0, _missing = 0;
+    int _last_seq = -1;
+
+    void _frame(const uint8_t* data, size_t len);
+    void _sample(uint8_t id, Channel& ch, uint8_t seq);
+    void _openColumns(uint8_t id, Channel& ch);
+};
+
+void Decoder::_frame(const uint8_t* data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    // Undo the COBS encoding
+    uint8_t raw[256];
+    size_t n = 0;
+    const uint8_t* end = data + len;
+    while (data < end)
+    {
+        uint8_t code = *data++;
+        if (code == 0 || data + code - 1 > end || n + code > sizeof(raw))
+        {
+            ++_bad;
+            return;
+        }
+        memcpy(raw + n, data, code - 1);
+        n += code - 1;
+        data += code - 1;
+        if (code < 0xff && data < end)
+            raw[n++] = 0;
+    }
+    if (n < 4 || crc8(raw, n - 1) != raw[n - 1])
+    {
+        // Also text sent before the stream started
+        ++_bad;
+        return;
+    }
+
+    uint8_t id = raw[0] & ~keyframe_flag;
+    bool key = raw[0] & keyframe_flag;
+    uint8_t seq = raw[1];
+    uint32_t fields[max_fields + 1];
+    unsigned nr = 0;
+    const uint8_t* pos = raw + 2;
+    const uint8_t* raw_end = raw + n - 1;
+    while (pos < raw_end)
+    {
+        if (nr == max_fields + 1 || !getVarint(pos, raw_end, fields[nr++]))
+        {
+            ++_bad;
+            return;
+        }
+    }
+    Channel& ch = _channels[id];
+    if (nr == 0 || (ch.seen && nr - 1 != ch.nr_fields))
+    {
+        ++_bad;
+        return;
+    }
+
+    ++_frames;
+    if (_last_seq >= 0 && seq != uint8_t(_last_seq + 1))
+    {
+        ++_gaps;
+        _missing += uint8_t(seq - _last_seq - 1);
+    }
+    _last_seq = seq;
+
+    ch.seen = true;
+    ch.nr_fields = nr - 1;
+    ++ch.frames;
+    if (!key && !ch.synced)
+    {
+        ++ch.unsynced;
+        return;
+    }
+
+    uint32_t prev_ms = ch.ms;
+    bool contiguous = ch.synced && ch.gaps_at_last == _gaps;
+    ch.ms = key ? fields[0] : ch.ms + fields[0];
+    for (unsigned i = 0; i < ch.nr_fields; ++i)
+    {
+        // Undo the zigzag encoding, changes wrap around at 16 bits
+        int16_t v = int16_t((fields[i+1] >> 1) ^ -(fields[i+1] & 1));
+        ch.values[i] = key ? v : int16_t(ch.values[i] + v);
+    }
+    if (key)
+        ++ch.keyframes;
+    if (contiguous)
+        ++ch.periods[std::min<uint32_t>(ch.ms - prev_ms, histogram_bins - 1)];
+    ch.synced = true;
+    ch.gaps_at_last = _gaps;
+    _sample(id, ch, seq);
+}
+
+void Decoder::_sample(uint8_t id, Channel& ch, uint8_t seq)
+{
+    for (unsigned i = 0; i < ch.nr_fields; ++i)
+        ch.stats[i].add(ch.values[i]);
+
+    if (id == _options.latency_channel && _options.latency_out < ch.nr_fields)
+    {
+        int16_t in = ch.values[_options.latency_in], out = ch.values[_options.latency_out];
+        if (ch.stats[0].n > 1)
+        {
+            if (ch.waiting && ch.ms - ch.change_ms > max_latency_ms)
+                ch.waiting = false;
+            if (ch.waiting && out != ch.prev_out)
+            {
+                ch.latencies.push_back(ch.ms - ch.change_ms);
+                ch.waiting = false;
+            }
+            if (!ch.waiting && in != ch.prev_in)
+            {
+                ch.waiting = true;
+                ch.change_ms = ch.ms;
+            }
+        }
+        ch.prev_in = in;
+        ch.prev_out = out;
+    }
+
+    if (_options.csv)
+    {
+        fprintf(_options.csv, "%u,%u,%u", id, seq, ch.ms);
+        for (unsigned i = 0; i < ch.nr_fields; ++i)
+            fprintf(_options.csv, ",%d", ch.values[i]);
+        fputc('\n', _options.csv);
+    }
+
+    if (!_options.columns_dir.empty())
+    {
+        if (!ch.columns.time)
+            _openColumns(id, ch);
+        if (ch.columns.time)
+        {
+            fwrite(&seq, 1, 1, ch.columns.seq);
+            fwrite(&ch.ms, sizeof(ch.ms), 1, ch.columns.time);
+            for (unsigned i = 0; i < ch.nr_fields; ++i)
+                fwrite(&ch.values[i], sizeof(ch.values[i]), 1, ch.columns.fields[i]);
+        }
+    }
+}
+
+std::string fieldName(uint8_t id, unsigned field)
+{
+    if (id < sizeof(known_channels) / sizeof(known_channels[0])
+            && field < known_channels[id].fields.size())
+        return known_channels[id].fields[field];
+    return "f" + std::to_string(field);
+}
+
+std::string channelName(uint8_t id)
+{
+    if (id < sizeof(known_channels) / sizeof(known_channels[0]))
+        return known_channels[id].name;
+    return "ch" + std::to_string(id);
+}
+
+void Decoder::_openColumns(uint8_t id, Channel& ch)
+{
+    // Files are named <channel>.<column>.<type>, values are little endian
+    std::string prefix = _options.columns_dir + "/" + channelName(id) + ".";
+    ch.columns.seq = fopen((prefix + "seq.u8").c_str(), "wb");
+    ch.columns.time = fopen((prefix + "time_ms.u32").c_str(), "wb");
+    for (unsigned i = 0; i < ch.nr_fields; ++i)
+        ch.columns.fields[i] = fopen((prefix + fieldName(id, i) + ".i16").c_str(), "wb");
+
+    bool ok = ch.columns.seq && ch.columns.time;
+    for (unsigned i = 0; i < ch.nr_fields; ++i)
+        ok = ok && ch.columns.fields[i];
+    if (!ok)
+    {
+        fprintf(stderr, "teledecode: cannot write columns in %s: %s\n",
+            _options.columns_dir.c_str(), strerror(errno));
+        exit(1);
+    }
+}
+
+void Decoder::closeColumns()
+{
+    for (Channel& ch: _channels)
+    {
+        if (!ch.columns.time)
+            continue;
+        fclose(ch.columns.seq);
+        fclose(ch.columns.time);
+        for (unsigned i = 0; i < ch.nr_fields; ++i)
+            fclose(ch.columns.fields[i]);
+    }
+}
+
+void printHistogram(FILE* f, const uint64_t* bins)
+{
+    uint64_t total = 0, peak = 0;
+    for (unsigned i = 0; i < histogram_bins; ++i)
+    {
+        total += bins[i];
+        peak = std::max(peak, bins[i]);
+    }
+    if (total == 0)
+        return;
+
+    fprintf(f, "  interval between frames:\n");
+    for (unsigned i = 0; i < histogram_bins; ++i)
+    {
+        if (bins[i] == 0)
+            continue;
+        fprintf(f, "    %s%3u ms %10llu %5.1f%% ", i == histogram_bins - 1 ? ">=" : "  ", i,
+            (unsigned long long)bins[i], 100.0 * bins[i] / total);
+        for (uint64_t j = 0; j < (bins[i] * 40 + peak - 1) / peak; ++j)
+            fputc('#', f);
+        fputc('\n', f);
+    }
+}
+
+void Decoder::printStats(FILE* f) const
+{
+    fprintf(f, "%llu bytes, %llu frames, %llu bad frames, %llu frames missing in %llu gaps\n",
+        (unsigned long long)_bytes, (unsigned long long)_frames,
+        (unsigned long long)_bad, (unsigned long long)_missing,
+        (unsigned long long)_gaps);
+
+    for (unsigned id = 0; id < nr_channels; ++id)
+    {
+        const Channel& ch = _channels[id];
+        if (!ch.seen)
+            continue;
+
+        fprintf(f, "\nchannel %u (%s): %llu frames, %llu key frames, %llu before the first key frame\n",
+            id, channelName(id).c_str(), (unsigned long long)ch.frames,
+            (unsigned long long)ch.keyframes, (unsigned long long)ch.unsynced);
+        fprintf(f, "  %-12s %8s %8s %10s %10s\n", "field", "min", "max", "mean", "stddev");
+        for (unsigned i = 0; i < ch.nr_fields; ++i)
+        {
+            const FieldStats& s = ch.stats[i];
+            if (s.n == 0)
+                continue;
+            fprintf(f, "  %-12s %8d %8d %10.2f %10.2f\n", fieldName(id, i).c_str(),
+                s.min, s.max, s.mean, s.stddev());
+        }
+        printHistogram(f, ch.periods);
+
+        if (!ch.latencies.empty())
+        {
+            std::vector<uint32_t> l = ch.latencies;
+            std::sort(l.begin(), l.end());
+            fprintf(f, "  latency %s -> %s: %zu responses, median %u ms, 90%% %u ms, "
+                "99%% %u ms, max %u ms\n",
+                fieldName(id, _options.latency_in).c_str(),
+                fieldName(id, _options.latency_out).c_str(), l.size(),
+                l[l.size() / 2], l[l.size() * 9 / 10], l[l.size() * 99 / 100], l.back());
+        }
+    }
+}
+
+speed_t baudConstant(unsigned long baud)
+{
+    switch (baud)
+    {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return 0;
+    }
+}
+
+/// Decode the file or device at \a path, or standard input if null
+bool decodeInput(const char* path, unsigned long baud, Decoder& decoder)
+{
+    int fd = path ? open(path, O_RDONLY | O_NOCTTY) : 0;
+    if (fd < 0)
+    {
+        fprintf(stderr, "teledecode: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            decoder.feed(static_cast<const uint8_t*>(data), st.st_size);
+            munmap(data, st.st_size);
+            close(fd);
+            return true;
+        }
+    }
+
+    if (isatty(fd))
+    {
+        struct termios tio;
+        speed_t speed = baudConstant(baud);
+        if (speed == 0 || tcgetattr(fd, &tio) != 0)
+        {
+            fprintf(stderr, "teledecode: cannot set %s to %lu baud\n", path, baud);
+            return false;
+        }
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    uint8_t buf[65536];
+    while (!interrupted)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        decoder.feed(buf, n);
+    }
+    if (path)
+        close(fd);
+    return true;
+}
+
+void onInterrupt(int)
+{
+    interrupted = 1;
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: teledecode [-b baud] [-c csv] [-o dir] [-l ch:in:out] [-q] "
+        "[capture file or serial port]\n");
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    unsigned long baud = 115200;
+    const char* csv_path = nullptr;
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:c:o:l:q")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': baud = strtoul(optarg, nullptr, 0); break;
+            case 'c': csv_path = optarg; break;
+            case 'o': options.columns_dir = optarg; break;
+            case 'l':
+                if (sscanf(optarg, "%d:%u:%u", &options.latency_channel,
+                        &options.latency_in, &options.latency_out) != 3
+                        || options.latency_in >= max_fields || options.latency_out >= max_fields)
+                    usage();
+                break;
+            case 'q': quiet = true; break;
+            default: usage();
+        }
+    }
+    if (optind < argc - 1)
+        usage();
+
+    if (csv_path)
+    {
+        options.csv = fopen(csv_path, "w");
+        if (!options.csv)
+        {
+            fprintf(stderr, "teledecode: %s: %s\n", csv_path, strerror(errno));
+            return 1;
+        }
+        fputs("channel,seq,time_ms,values\n", options.csv);
+    }
+    if (!options.columns_dir.empty())
+        mkdir(options.columns_dir.c_str(), 0777);
+
+    // Stop reading a serial port on ^C, and still print the statistics
+    signal(SIGINT, onInterrupt);
+
+    Decoder decoder(options);
+    bool ok = decodeInput(optind < argc ? argv[optind] : nullptr, baud, decoder);
+    decoder.closeColumns();
+    if (options.csv)
+        fclose(options.csv);
+    if (!quiet)
+        decoder.printStats(stdout);
+    return ok ? 0 : 1;
+}
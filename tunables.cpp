@@ -0,0 +1,166 @@
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "tunables.h"
+#include "hal.h"
+
+namespace
+{
+
+/// Parse the decimal number in \a s into \a value. Returns \c false if it is not one.
+bool parseInt(const char* s, long& value)
+{
+    bool negative = *s == '-';
+    if (negative)
+        ++s;
+    if (!*s)
+        return false;
+
+    value = 0;
+    for (; *s; ++s)
+    {
+        // Commands are short, so the value cannot overflow before this check
+        if (*s < '0' || *s > '9' || value > 0x7fff)
+            return false;
+        value = value * 10 + (*s - '0');
+    }
+    if (negative)
+        value = -value;
+    return true;
+}
+
+} // namespace
+
+bool Tunables::load()
+{
+    int16_t data[1 + max_tunables];
+    int len = _log.read(_key, data, sizeof(data));
+    if (len != int(sizeof(int16_t)) * (1 + _count) || uint16_t(data[0]) != _namesCrc())
+        return false;
+
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        Tunable t;
+        memcpy_P(&t, &_table[i], sizeof(t));
+        *t.value = constrain(data[1 + i], t.min, t.max);
+    }
+    return true;
+}
+
+Tunables::Result Tunables::poll(uint32_t now)
+{
+    if (_listing < _count)
+    {
+        int value = *static_cast<int*>(pgm_read_ptr(&_table[_listing].value));
+        if (_reply(now, _listing, value))
+            ++_listing;
+        return NONE;
+    }
+
+    for (uint8_t n = 0; n < max_bytes_per_poll && Serial.available() > 0; ++n)
+    {
+        char c = Serial.read();
+        if (c != '\r' && c != '\n')
+        {
+            if (_len < max_line)
+                _line[_len++] = c;
+            else
+                _overflow = true;
+            continue;
+        }
+
+        // End of a command; skip empty lines, such as the second half of CRLF
+        if (_len == 0 && !_overflow)
+            continue;
+        _line[_len] = 0;
+        _len = 0;
+        if (_overflow)
+        {
+            _overflow = false;
+            _reply(now, -1, UNKNOWN);
+            return NONE;
+        }
+        return _execute(now);
+    }
+    return NONE;
+}
+
+Tunables::Result Tunables::_execute(uint32_t now)
+{
+    if (strcmp_P(_line, PSTR("?")) == 0)
+    {
+        // The replies are sent by the next calls to poll()
+        _listing = 0;
+        return NONE;
+    }
+    if (strcmp_P(_line, PSTR("save")) == 0)
+    {
+        _reply(now, -1, _save());
+        return NONE;
+    }
+
+    char* value = strchr(_line, '=');
+    if (value)
+        *value++ = 0;
+    int8_t i = _find(_line);
+    if (i < 0)
+    {
+        // Not ours; restore the line for the caller
+        if (value)
+            value[-1] = '=';
+        return OTHER;
+    }
+
+    Tunable t;
+    memcpy_P(&t, &_table[i], sizeof(t));
+    if (!value)
+    {
+        _reply(now, i, *t.value);
+        return NONE;
+    }
+
+    long v;
+    if (!parseInt(value, v) || v < t.min || v > t.max)
+    {
+        _reply(now, -1, INVALID);
+        return NONE;
+    }
+    *t.value = v;
+    _reply(now, i, v);
+    return CHANGED;
+}
+
+Tunables::Error Tunables::_save()
+{
+    int16_t data[1 + max_tunables];
+    data[0] = _namesCrc();
+    for (uint8_t i = 0; i < _count; ++i)
+        data[1 + i] = *static_cast<int*>(pgm_read_ptr(&_table[i].value));
+    return _log.write(_key, data, sizeof(int16_t) * (1 + _count)) ? OK : BUSY;
+}
+
+int8_t Tunables::_find(const char* name) const
+{
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        if (strcmp_P(name, static_cast<const char*>(pgm_read_ptr(&_table[i].name))) == 0)
+            return i;
+    }
+    return -1;
+}
+
+uint16_t Tunables::_namesCrc() const
+{
+    uint16_t crc = 0xffff;
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        const char* name = static_cast<const char*>(pgm_read_ptr(&_table[i].name));
+        // Include the terminating zero, so that names cannot run together
+        char c;
+        do
+        {
+            c = pgm_read_byte(name++);
+            crc = _crc16_update(crc, c);
+        } while (c);
+    }
+    return crc;
+}
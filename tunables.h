@@ -0,0 +1,146 @@
+#ifndef TUNABLES_H
+#define TUNABLES_H
+
+#include <Arduino.h>
+#include "eepromlog.h"
+#include "telemetry.h"
+
+/**
+ * Parameters that can be changed over the serial port
+ *
+ * Class Tunables holds a registry of named integer parameters, and reads
+ * commands to inspect and change them from the serial port, so that the
+ * robot can be tuned without flashing it again. The registry is a table of
+ * Tunable entries in program memory, each pointing to the variable holding
+ * the parameter, with its valid range.
+ *
+ * Commands are lines of text, terminated by a carriage return or newline:
+ *  - \c name prints the value of parameter \c name;
+ *  - \c name=value sets it;
+ *  - \c ? prints all parameters;
+ *  - \c save commits the current values to EEPROM, from where load() reads
+ *    them at start up.
+ * Since the serial output carries the binary telemetry stream, replies are
+ * sent as telemetry frames on the channel given to the constructor, with two
+ * fields: the index of the parameter in the table and its value, or -1 and
+ * an Error code in reply to a failed command or to \c save.
+ *
+ * poll() never blocks: it reads at most \c max_bytes_per_poll bytes, and
+ * executes at most one command, which takes a lookup in the table. The
+ * replies to \c ? are sent one per call, so that they cannot overflow the
+ * telemetry ring; a reply that is dropped is sent again. Values
+ * are saved with EEPromLog, which writes in the background, as a single
+ * record holding all values in table order, preceded by a CRC16 over the
+ * parameter names, so that values saved with a different table are ignored.
+ */
+class Tunables
+{
+public:
+    /// Maximum length of a command
+    static const uint8_t max_line = 24;
+    /// Maximum number of bytes read from the serial port per call to poll()
+    static const uint8_t max_bytes_per_poll = 8;
+    /// Maximum number of parameters that fit in a single EEPromLog record
+    static const uint8_t max_tunables = (EEPromLog::max_len - 2) / 2;
+
+    /// A parameter, to be stored in program memory
+    struct Tunable
+    {
+        /// Name of the parameter, in program memory
+        const char* name;
+        /// Variable holding the value
+        int* value;
+        /// Range of valid values
+        int min, max;
+    };
+
+    /// Result of poll()
+    enum Result: uint8_t
+    {
+        /// No complete command was read
+        NONE,
+        /// One or more parameters were changed
+        CHANGED,
+        /// A command was read that is not a parameter command, see command()
+        OTHER
+    };
+
+    /// Error codes in replies
+    enum Error: int16_t
+    {
+        OK,
+        /// There is no parameter with this name, or the command is too long
+        UNKNOWN,
+        /// The value is not a number, or it is out of range
+        INVALID,
+        /// The EEPROM log cannot take the write now, retry later
+        BUSY
+    };
+
+    /**
+     * Constructor
+     *
+     * Create a registry of the \a count parameters in table \a table, saved
+     * in \a log under key \a key, with replies sent on telemetry channel
+     * \a channel of \a telemetry. Only the first \c max_tunables entries
+     * of a longer table are used.
+     */
+    Tunables(const Tunable* table, uint8_t count, EEPromLog& log, uint8_t key,
+        Telemetry& telemetry, uint8_t channel):
+        _table(table), _count(count < max_tunables ? count : uint8_t(max_tunables)),
+        _log(log), _key(key), _telemetry(telemetry), _channel(channel, 2),
+        _len(0), _overflow(false), _listing(_count), _line{0} {}
+
+    /**
+     * Load the values saved in EEPROM, if any. Call this at start up, after
+     * EEPromLog::begin(). Returns \c false if no values were saved.
+     */
+    bool load();
+    /**
+     * Read and execute commands
+     *
+     * Read the bytes available on the serial port, up to
+     * \c max_bytes_per_poll, and execute the command if one is complete.
+     * While the replies to \c ? are being sent, send the next one instead.
+     * Replies are sent with time stamp \a now. This should be called every
+     * pass through loop().
+     */
+    Result poll(uint32_t now);
+    /// Return the last command read, after poll() returned \c OTHER
+    const char* command() const { return _line; }
+
+private:
+    const Tunable* _table;
+    uint8_t _count;
+    EEPromLog& _log;
+    uint8_t _key;
+    Telemetry& _telemetry;
+    Telemetry::Channel _channel;
+    /// Number of bytes in _line
+    uint8_t _len;
+    /// Whether the current line is too long, and is skipped
+    bool _overflow;
+    /// Index of the next parameter to send in reply to \c ?, or _count
+    uint8_t _listing;
+    char _line[max_line + 1];
+
+    /// Execute the command in _line
+    Result _execute(uint32_t now);
+    /// Save all values in EEPROM
+    Error _save();
+    /// Return the index of the parameter named \a name, or -1 if there is none
+    int8_t _find(const char* name) const;
+    /// Return the CRC16 of the names of all parameters
+    uint16_t _namesCrc() const;
+    /**
+     * Send a reply with fields \a index and \a value. Returns \c false if
+     * it was dropped.
+     */
+    bool _reply(uint32_t now, int16_t index, int16_t value)
+    {
+        int16_t values[] = { index, value };
+        return _telemetry.send(_channel, now, values);
+    }
+};
+
+#endif // TUNABLES_H
@@ -145,7 +145,6 @@ public:
 
     Matrix<N-1> minorMatrix(int row, int col) const
     {
-        int im, jm;
         Matrix<N-1> ret;
         for (int i = 0, im = 0; i < N; ++i)
         {